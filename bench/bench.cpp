@@ -0,0 +1,774 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bvh_node.h"
+#include "box.h"
+#include "camera.h"
+#include "linear_bvh.h"
+#include "material_registry.h"
+#include "mesh_loader.h"
+#include "rect_box.h"
+#include "renderer.h"
+#include "sampler.h"
+#include "scene_factory.h"
+#include "scene_loader.h"
+#include "timer.h"
+#include "top_level_bvh.h"
+#include "transform.h"
+#include "triangle_mesh.h"
+#include "virtual_material.h"
+#include "wide_bvh.h"
+
+/*
+ *  Micro benchmarks for the parts of the renderer we are trying to speed up.
+ *  Run with no arguments to run all of them, or pass the names of the ones
+ *  to run.
+ */
+
+static Camera random_scene_camera()
+{
+	return Camera(vec3(13.f, 2.f, 3.f),
+				  vec3(0.f, 0.f, 0.f),
+				  vec3(0.f, 1.f, 0.f),
+				  20.f,
+				  2.f,
+				  0.f,
+				  10.f,
+				  0.f,
+				  1.f);
+}
+
+// traces primary rays through the world and reports the throughput
+static void trace_primary_rays(const std::string& title,
+							   const Hittable& world,
+							   const Camera& cam,
+							   int num_rays)
+{
+	Sampler sampler(1);
+	int num_hits = 0;
+
+	Timer t(title);
+	for(int i = 0; i < num_rays; i++)
+	{
+		HitRecord rec;
+		Ray r = cam.get_ray(sampler.next_float(), sampler.next_float(), sampler);
+		if(world.hit(r, 0.001f, std::numeric_limits<float>::max(), rec)) num_hits++;
+	}
+	t.stop();
+
+	const double seconds = std::max(1ll, t.duration()) / 1000.0;
+	std::cout << "  " << num_rays / seconds / 1e6 << " Mrays/s, " << num_hits << " hits\n";
+}
+
+static void bench_bvh_split()
+{
+	constexpr int num_rays = 1000000;
+	MaterialRegistry materials;
+	const hittables_vec objects = SceneFactory::random_scene_objects(materials);
+	const Camera cam = random_scene_camera();
+
+	std::cout << "random_scene(): " << objects.size() << " objects\n";
+
+	const std::pair<const char*, BVHSplit> splits[] = {{"median", BVHSplit::Median},
+													   {"SAH", BVHSplit::SAH},
+													   {"Morton", BVHSplit::Morton}};
+	for(const auto& split : splits)
+	{
+		Timer build_timer(std::string(split.first) + " build");
+		BVHNode bvh(objects, 0.f, 1.f, split.second);
+		build_timer.stop();
+
+		bvh.stats().print(std::cout);
+		trace_primary_rays(std::string(split.first) + " traversal", bvh, cam, num_rays);
+	}
+}
+
+static void bench_bvh_layout()
+{
+	constexpr int num_rays = 1000000;
+	MaterialRegistry materials;
+	const hittables_vec objects = SceneFactory::random_scene_objects(materials);
+	const Camera cam = random_scene_camera();
+
+	{
+		BVHNode bvh(objects, 0.f, 1.f, BVHSplit::SAH);
+		trace_primary_rays("BVHNode traversal", bvh, cam, num_rays);
+	}
+
+	{
+		Timer build_timer("LinearBVHList build");
+		LinearBVHList bvh(objects, 0.f, 1.f, BVHSplit::SAH);
+		build_timer.stop();
+
+		bvh.stats().print(std::cout);
+		trace_primary_rays("LinearBVHList traversal", bvh, cam, num_rays);
+	}
+}
+
+static void bench_bvh_wide()
+{
+	constexpr int num_rays = 1000000;
+	MaterialRegistry materials;
+	const hittables_vec objects = SceneFactory::random_scene_objects(materials);
+	const Camera cam = random_scene_camera();
+
+	{
+		LinearBVHList bvh(objects, 0.f, 1.f);
+		std::cout << "binary:\n";
+		bvh.stats().print(std::cout);
+		trace_primary_rays("LinearBVHList traversal", bvh, cam, num_rays);
+	}
+
+	{
+		BVH4List bvh(objects, 0.f, 1.f);
+		std::cout << "4 wide:\n";
+		bvh.stats().print(std::cout);
+		trace_primary_rays("BVH4List traversal", bvh, cam, num_rays);
+	}
+
+	{
+		BVH8List bvh(objects, 0.f, 1.f);
+		std::cout << "8 wide:\n";
+		bvh.stats().print(std::cout);
+		trace_primary_rays("BVH8List traversal", bvh, cam, num_rays);
+	}
+}
+
+// builds LinearBVHs over a million small random boxes on more and more threads
+static void bench_bvh_build()
+{
+	constexpr int num_boxes = 1000000;
+	std::mt19937 mt_engine(1);
+	std::uniform_real_distribution<float> position(-100.f, 100.f), size(0.01f, 1.f);
+	std::vector<AABB> boxes(num_boxes);
+	for(AABB& box : boxes)
+	{
+		const vec3 p(position(mt_engine), position(mt_engine), position(mt_engine));
+		box = AABB(p, p + vec3(size(mt_engine), size(mt_engine), size(mt_engine)));
+	}
+
+	std::cout << num_boxes << " boxes on " << default_num_threads(0) << " cores\n";
+	const std::pair<const char*, BVHSplit> splits[] = {{"median", BVHSplit::Median},
+													   {"SAH", BVHSplit::SAH}};
+	for(const auto& split : splits)
+	{
+		for(unsigned num_threads : {1u, 2u, 4u, 8u})
+		{
+			Timer t(std::string(split.first) + " build on " + std::to_string(num_threads) +
+					" threads");
+			LinearBVH bvh(boxes, split.second, 4, num_threads);
+			t.stop();
+		}
+	}
+}
+
+// rays between random points in the world's bounds, like shadow rays
+static void trace_shadow_rays(const std::string& title, const Hittable& world, int num_rays)
+{
+	AABB bounds;
+	if(!world.bounding_box(0.f, 1.f, bounds))
+	{
+		std::cout << title << " has no bounding box\n";
+		return;
+	}
+
+	const vec3 extent = bounds.max() - bounds.min();
+	auto random_point = [&](Sampler& sampler) {
+		return bounds.min() + vec3(sampler.next_float() * extent.x(),
+								   sampler.next_float() * extent.y(),
+								   sampler.next_float() * extent.z());
+	};
+
+	for(int pass = 0; pass < 2; pass++)
+	{
+		Sampler sampler(1);
+		int num_blocked = 0;
+
+		Timer t(title + (pass == 0 ? " hit" : " occluded"));
+		for(int i = 0; i < num_rays; i++)
+		{
+			vec3 from = random_point(sampler);
+			Ray r(from, random_point(sampler) - from);
+			HitRecord rec;
+			if(pass == 0 ? world.hit(r, 0.001f, 0.999f, rec) : world.occluded(r, 0.001f, 0.999f))
+				num_blocked++;
+		}
+		t.stop();
+
+		const double seconds = std::max(1ll, t.duration()) / 1000.0;
+		std::cout << "  " << num_rays / seconds / 1e6 << " Mrays/s, " << num_blocked
+				  << " blocked\n";
+	}
+}
+
+static void bench_occlusion()
+{
+	constexpr int num_rays = 1000000;
+
+	MaterialRegistry materials;
+	LinearBVHList random_scene(SceneFactory::random_scene_objects(materials), 0.f, 1.f);
+	trace_shadow_rays("random_scene", random_scene, num_rays);
+	trace_shadow_rays("cornell_box", *SceneFactory::cornell_box().world, num_rays);
+}
+
+// scatters and evaluates random hits with the same materials in both the
+// variant based MaterialRegistry and the old virtual hierarchy
+static void bench_shading()
+{
+	constexpr int num_materials = 500;
+	constexpr int num_hits = 1 << 16;
+	constexpr int num_passes = 32;
+
+	MaterialRegistry registry;
+	std::vector<std::shared_ptr<virtual_material::Material>> virtual_materials;
+
+	// mixed like random_scene(): a checker floor, then mostly diffuse, some metal and glass
+	Sampler sampler(1);
+	const TextureId even = registry.add_texture(ConstantTexture(vec3(0.2f, 0.3f, 0.1f)));
+	const TextureId odd = registry.add_texture(ConstantTexture(vec3(0.9f, 0.9f, 0.9f)));
+	registry.emplace<Lambertian>(registry.add_texture(CheckerTexture(even, odd)));
+	virtual_materials.push_back(std::make_shared<virtual_material::Lambertian>(
+		std::make_shared<virtual_material::CheckerTexture>(
+			std::make_shared<virtual_material::ConstantTexture>(vec3(0.2f, 0.3f, 0.1f)),
+			std::make_shared<virtual_material::ConstantTexture>(vec3(0.9f, 0.9f, 0.9f)))));
+
+	for(int i = 1; i < num_materials; i++)
+	{
+		const float choose_mat = sampler.next_float();
+		const vec3 colour(sampler.next_float(), sampler.next_float(), sampler.next_float());
+		if(choose_mat < 0.8f)
+		{
+			registry.emplace<Lambertian>(registry.add_texture(ConstantTexture(colour)));
+			virtual_materials.push_back(std::make_shared<virtual_material::Lambertian>(
+				std::make_shared<virtual_material::ConstantTexture>(colour)));
+		}
+		else if(choose_mat < 0.95f)
+		{
+			registry.emplace<Metal>(colour, 0.5f * colour.x());
+			virtual_materials.push_back(
+				std::make_shared<virtual_material::Metal>(colour, 0.5f * colour.x()));
+		}
+		else
+		{
+			registry.emplace<Dielectric>(1.5f);
+			virtual_materials.push_back(std::make_shared<virtual_material::Dielectric>(1.5f));
+		}
+	}
+
+	std::vector<HitRecord> hits(num_hits);
+	std::vector<Ray> rays(num_hits);
+	for(int i = 0; i < num_hits; i++)
+	{
+		HitRecord& rec = hits[i];
+		rec.t = 1.f;
+		rec.normal = random_unit_vector(sampler);
+		rec.p = 10.f * vec3(sampler.next_float(), sampler.next_float(), sampler.next_float());
+		rec.u = sampler.next_float();
+		rec.v = sampler.next_float();
+		// the floor is hit far more often than any other object
+		rec.material = sampler.next_float() < 0.3f
+						   ? 0
+						   : std::min(static_cast<MaterialId>(sampler.next_float() * num_materials),
+									  static_cast<MaterialId>(num_materials - 1));
+		rays[i] = Ray(rec.p + rec.normal + 0.5f * random_unit_vector(sampler), -rec.normal);
+	}
+
+	const vec3 to_light = unit_vector(vec3(1.f, 4.f, 2.f));
+	auto report = [&](Timer& t, const vec3& sum) {
+		t.stop();
+		const double seconds = std::max(1ll, t.duration()) / 1000.0;
+		std::cout << "  " << double(num_hits) * num_passes / seconds / 1e6
+				  << " Mshades/s, checksum " << sum.x() + sum.y() + sum.z() << "\n";
+	};
+
+	{
+		Sampler s(2);
+		vec3 sum(0.f, 0.f, 0.f);
+		Timer t("virtual");
+		for(int pass = 0; pass < num_passes; pass++)
+		{
+			for(int i = 0; i < num_hits; i++)
+			{
+				const virtual_material::Material& mat = *virtual_materials[hits[i].material];
+				vec3 attenuation;
+				Ray scattered;
+				if(mat.scatter(rays[i], hits[i], attenuation, scattered, s)) sum += attenuation;
+				if(!mat.is_specular()) sum += mat.eval(rays[i], hits[i], to_light);
+			}
+		}
+		report(t, sum);
+	}
+
+	{
+		Sampler s(2);
+		vec3 sum(0.f, 0.f, 0.f);
+		Timer t("variant");
+		for(int pass = 0; pass < num_passes; pass++)
+		{
+			for(int i = 0; i < num_hits; i++)
+			{
+				vec3 attenuation;
+				Ray scattered;
+				if(registry.scatter(rays[i], hits[i], attenuation, scattered, s))
+					sum += attenuation;
+				if(!registry.is_specular(hits[i].material))
+					sum += registry.eval(rays[i], hits[i], to_light);
+			}
+		}
+		report(t, sum);
+	}
+}
+
+// unit sphere made of 2 * rings * segments triangles, with normals and uvs
+static MeshData sphere_mesh(int rings, int segments)
+{
+	MeshData mesh;
+	for(int i = 0; i <= rings; i++)
+	{
+		const float theta = static_cast<float>(M_PI) * i / rings;
+		for(int j = 0; j <= segments; j++)
+		{
+			const float phi = 2.f * static_cast<float>(M_PI) * j / segments;
+			const vec3 p(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+			mesh.px.push_back(p.x());
+			mesh.py.push_back(p.y());
+			mesh.pz.push_back(p.z());
+			mesh.nx.push_back(p.x());
+			mesh.ny.push_back(p.y());
+			mesh.nz.push_back(p.z());
+			mesh.tu.push_back(static_cast<float>(j) / segments);
+			mesh.tv.push_back(1.f - static_cast<float>(i) / rings);
+		}
+	}
+
+	auto vertex = [segments](int i, int j) {
+		return static_cast<uint32_t>(i * (segments + 1) + j);
+	};
+	for(int i = 0; i < rings; i++)
+	{
+		for(int j = 0; j < segments; j++)
+		{
+			const uint32_t a = vertex(i, j), b = vertex(i, j + 1);
+			const uint32_t c = vertex(i + 1, j + 1), d = vertex(i + 1, j);
+			mesh.indices.insert(mesh.indices.end(), {a, b, c, a, c, d});
+		}
+	}
+
+	return mesh;
+}
+
+static void write_ply(const std::string& path, const MeshData& mesh)
+{
+	FILE* f = std::fopen(path.c_str(), "wb");
+	std::fprintf(f,
+				 "ply\nformat binary_little_endian 1.0\nelement vertex %zu\n"
+				 "property float x\nproperty float y\nproperty float z\n"
+				 "property float nx\nproperty float ny\nproperty float nz\n"
+				 "property float u\nproperty float v\n"
+				 "element face %zu\nproperty list uchar int vertex_indices\nend_header\n",
+				 mesh.num_vertices(),
+				 mesh.num_triangles());
+	for(size_t i = 0; i < mesh.num_vertices(); i++)
+	{
+		const float v[8] = {mesh.px[i],
+							mesh.py[i],
+							mesh.pz[i],
+							mesh.nx[i],
+							mesh.ny[i],
+							mesh.nz[i],
+							mesh.tu[i],
+							mesh.tv[i]};
+		std::fwrite(v, sizeof(v), 1, f);
+	}
+	for(size_t i = 0; i < mesh.num_triangles(); i++)
+	{
+		const unsigned char n = 3;
+		std::fwrite(&n, 1, 1, f);
+		std::fwrite(&mesh.indices[3 * i], sizeof(uint32_t), 3, f);
+	}
+	std::fclose(f);
+}
+
+static void write_obj(const std::string& path, const MeshData& mesh)
+{
+	FILE* f = std::fopen(path.c_str(), "w");
+	for(size_t i = 0; i < mesh.num_vertices(); i++)
+		std::fprintf(f, "v %f %f %f\n", mesh.px[i], mesh.py[i], mesh.pz[i]);
+	for(size_t i = 0; i < mesh.num_vertices(); i++)
+		std::fprintf(f, "vn %f %f %f\n", mesh.nx[i], mesh.ny[i], mesh.nz[i]);
+	for(size_t i = 0; i < mesh.num_vertices(); i++)
+		std::fprintf(f, "vt %f %f\n", mesh.tu[i], mesh.tv[i]);
+	for(size_t i = 0; i < mesh.num_triangles(); i++)
+	{
+		std::fprintf(f, "f");
+		for(int c = 0; c < 3; c++)
+		{
+			const uint32_t v = mesh.indices[3 * i + c] + 1;
+			std::fprintf(f, " %u/%u/%u", v, v, v);
+		}
+		std::fprintf(f, "\n");
+	}
+	std::fclose(f);
+}
+
+// looks at sphere_mesh() from outside
+static Camera sphere_mesh_camera()
+{
+	return Camera(vec3(0.f, 0.f, 4.f),
+				  vec3(0.f, 0.f, 0.f),
+				  vec3(0.f, 1.f, 0.f),
+				  40.f,
+				  1.f,
+				  0.f,
+				  4.f,
+				  0.f,
+				  1.f);
+}
+
+// loads a generated mesh from PLY and OBJ, then builds its BVH and traces it
+static void bench_mesh()
+{
+	constexpr int num_rays = 1000000;
+	const MeshData generated = sphere_mesh(1000, 1000);
+	const auto dir = std::filesystem::temp_directory_path();
+	const std::string ply_path = (dir / "raytracer_bench_mesh.ply").string();
+	const std::string obj_path = (dir / "raytracer_bench_mesh.obj").string();
+	write_ply(ply_path, generated);
+	write_obj(obj_path, generated);
+
+	std::cout << generated.num_triangles() << " triangles, " << generated.num_vertices()
+			  << " vertices\n";
+
+	std::shared_ptr<MeshData> mesh;
+	{
+		Timer t("PLY load");
+		mesh = MeshLoader::load(ply_path);
+	}
+	{
+		Timer t("OBJ load");
+		auto obj = MeshLoader::load(obj_path);
+		std::cout << "  " << (obj ? obj->num_triangles() : 0) << " triangles\n";
+	}
+	std::remove(ply_path.c_str());
+	std::remove(obj_path.c_str());
+	if(!mesh) return;
+
+	std::cout << "  " << mesh->memory_usage() / (1024 * 1024) << " MB of mesh data\n";
+
+	Timer build_timer("BVH build");
+	TriangleMesh triangles(mesh, 0);
+	build_timer.stop();
+	triangles.stats().print(std::cout);
+
+	trace_primary_rays("TriangleMesh traversal", triangles, sphere_mesh_camera(), num_rays);
+}
+
+// build time against tree quality for every split, rebuilding a mesh's BVH
+static void bench_bvh_morton()
+{
+	constexpr int num_rays = 1000000;
+	const auto mesh = std::make_shared<const MeshData>(sphere_mesh(1000, 1000));
+	std::cout << mesh->num_triangles() << " triangles\n";
+
+	const std::pair<const char*, BVHSplit> splits[] = {{"median", BVHSplit::Median},
+													   {"SAH", BVHSplit::SAH},
+													   {"Morton", BVHSplit::Morton}};
+	for(const auto& split : splits)
+	{
+		Timer build_timer(std::string(split.first) + " build");
+		TriangleMesh triangles(mesh, 0, split.second);
+		build_timer.stop();
+
+		triangles.stats().print(std::cout);
+		trace_primary_rays(
+			std::string(split.first) + " traversal", triangles, sphere_mesh_camera(), num_rays);
+	}
+}
+
+// a grid of boxes as separate copies in one BVH, and as instances of one box
+static void bench_instancing()
+{
+	constexpr int num_rays = 1000000;
+	constexpr int grid_size = 100;
+	const vec3 box_min(-0.5f, 0.f, -0.5f), box_max(0.5f, 1.f, 0.5f);
+
+	std::vector<vec3> positions;
+	for(int i = 0; i < grid_size; i++)
+		for(int j = 0; j < grid_size; j++)
+			positions.emplace_back(1.5f * (i - grid_size / 2), 0.f, 1.5f * (j - grid_size / 2));
+
+	const Camera cam(vec3(0.f, 30.f, 90.f),
+					 vec3(0.f, 0.f, 0.f),
+					 vec3(0.f, 1.f, 0.f),
+					 40.f,
+					 2.f,
+					 0.f,
+					 10.f,
+					 0.f,
+					 1.f);
+	std::cout << positions.size() << " boxes\n";
+
+	{
+		Timer build_timer("copies build");
+		hittables_vec boxes;
+		for(const vec3& p : positions)
+			boxes.emplace_back(std::make_shared<Box>(box_min + p, box_max + p, 0));
+		LinearBVHList bvh(boxes, 0.f, 1.f);
+		build_timer.stop();
+
+		trace_primary_rays("copies traversal", bvh, cam, num_rays);
+	}
+
+	{
+		Timer build_timer("instances build");
+		auto box = std::make_shared<Box>(box_min, box_max, 0);
+		std::vector<Instance> instances;
+		for(const vec3& p : positions) instances.push_back({box, Affine::translation(p)});
+		TopLevelBVH tlas(instances, 0.f, 1.f);
+		build_timer.stop();
+
+		std::cout << "  " << tlas.num_instances() << " instances of " << tlas.num_blas()
+				  << " box\n";
+		trace_primary_rays("instances traversal", tlas, cam, num_rays);
+	}
+}
+
+// the two boxes of cornell_box() placed the same way, built from BoxType
+template<typename BoxType>
+static HittableList cornell_boxes()
+{
+	hittables_vec boxes;
+	boxes.emplace_back(std::make_shared<Transform>(
+		std::make_shared<BoxType>(vec3(0.f, 0.f, 0.f), vec3(165.f, 165.f, 165.f), 0),
+		Affine::translation(vec3(130.f, 0.f, 65.f)) * Affine::rotation_y(-18.f)));
+	boxes.emplace_back(std::make_shared<Transform>(
+		std::make_shared<BoxType>(vec3(0.f, 0.f, 0.f), vec3(165.f, 330.f, 165.f), 0),
+		Affine::translation(vec3(265.f, 0.f, 295.f)) * Affine::rotation_y(15.f)));
+	return HittableList(boxes, static_cast<int>(boxes.size()));
+}
+
+static void bench_box()
+{
+	constexpr int num_rays = 4000000;
+	const Camera cam(vec3(278.f, 278.f, -800.f),
+					 vec3(278.f, 278.f, 0.f),
+					 vec3(0.f, 1.f, 0.f),
+					 40.f,
+					 1.f,
+					 0.f,
+					 10.f,
+					 0.f,
+					 1.f);
+
+	trace_primary_rays("six rects", cornell_boxes<RectBox>(), cam, num_rays);
+	trace_primary_rays("slabs", cornell_boxes<Box>(), cam, num_rays);
+	trace_primary_rays("cornell_box", *SceneFactory::cornell_box().world, cam, num_rays);
+}
+
+static Camera cornell_box_camera()
+{
+	return Camera(vec3(278.f, 278.f, -800.f),
+				  vec3(278.f, 278.f, 0.f),
+				  vec3(0.f, 1.f, 0.f),
+				  40.f,
+				  1.f,
+				  0.f,
+				  10.f,
+				  0.f,
+				  1.f);
+}
+
+// mean absolute difference of the 8 bit pixel values of two images
+static double mean_error(const std::vector<unsigned char>& image,
+						 const std::vector<unsigned char>& reference)
+{
+	double sum = 0.0;
+	for(size_t i = 0; i < image.size(); i++) sum += std::abs(int(image[i]) - int(reference[i]));
+	return sum / image.size();
+}
+
+// error of small cornell_box() renders against a high sample count reference
+// for each sample sequence; a sequence reaching the same error with fewer
+// samples per pixel needs less time for the same image. The error is the
+// mean absolute difference of the 8 bit pixels over a few seeds, which the
+// scene's occasional fireflies throw off less than a squared error.
+static void bench_sampling()
+{
+	constexpr int size = 64;
+	constexpr int reference_samples = 1024;
+	constexpr int num_seeds = 4;
+	const Camera cam = cornell_box_camera();
+	const Scene scene = SceneFactory::cornell_box();
+
+	Timer reference_timer("reference, " + std::to_string(reference_samples) + " spp");
+	const std::vector<unsigned char> reference =
+		Renderer(size, size, reference_samples, 16, 0, 1, SampleSequence::Sobol).render(cam, scene);
+	reference_timer.stop();
+
+	const std::pair<const char*, SampleSequence> sequences[] = {
+		{"independent", SampleSequence::Independent},
+		{"sobol", SampleSequence::Sobol},
+		{"halton", SampleSequence::Halton}};
+	for(const auto& sequence : sequences)
+	{
+		std::cout << sequence.first << "\n";
+		for(int num_samples : {4, 16, 64})
+		{
+			double sum = 0.0;
+			for(int seed = 2; seed < 2 + num_seeds; seed++)
+			{
+				Renderer renderer(size, size, num_samples, 16, 0, seed, sequence.second);
+				sum += mean_error(renderer.render(cam, scene), reference);
+			}
+			std::cout << "  " << num_samples << " spp: mean error " << sum / num_seeds << "\n";
+		}
+	}
+}
+
+// fixed sample counts against adaptive sampling in batches of 16, on a scene
+// that is noisy everywhere and one that is mostly black background
+static void bench_adaptive()
+{
+	constexpr int size = 64;
+	constexpr int reference_samples = 1024;
+	constexpr int batch = 16, max_samples = 256;
+
+	const std::pair<const char*, std::pair<Scene, Camera>> scenes[] = {
+		{"cornell_box", {SceneFactory::cornell_box(), cornell_box_camera()}},
+		{"simple_light",
+		 {SceneFactory::simple_light(),
+		  Camera(vec3(26.f, 3.f, 6.f),
+				 vec3(0.f, 2.f, 0.f),
+				 vec3(0.f, 1.f, 0.f),
+				 20.f,
+				 1.f,
+				 0.f,
+				 10.f,
+				 0.f,
+				 1.f)}}};
+	for(const auto& entry : scenes)
+	{
+		const Scene& scene = entry.second.first;
+		const Camera& cam = entry.second.second;
+		std::cout << entry.first << "\n";
+		const std::vector<unsigned char> reference =
+			Renderer(size, size, reference_samples, 16, 0, 1).render(cam, scene);
+
+		for(int num_samples : {16, 64})
+		{
+			Timer t("  " + std::to_string(num_samples) + " spp");
+			const std::vector<unsigned char> image =
+				Renderer(size, size, num_samples, 16, 0, 2).render(cam, scene);
+			t.stop();
+			std::cout << "    mean error " << mean_error(image, reference) << "\n";
+		}
+
+		for(float threshold : {0.02f, 0.01f})
+		{
+			Renderer renderer(size, size, batch, 16, 0, 2);
+			renderer.set_adaptive(max_samples, threshold);
+			std::vector<int> samples_used;
+
+			Timer t("  adaptive, threshold " + std::to_string(threshold));
+			const std::vector<unsigned char> image =
+				renderer.render(cam, scene, PathTracer(), &samples_used);
+			t.stop();
+
+			double average = 0.0;
+			for(int n : samples_used) average += n;
+			std::cout << "    mean error " << mean_error(image, reference) << ", "
+					  << average / samples_used.size() << " spp on average\n";
+		}
+	}
+}
+
+// writes a scene file with a grid of a million small spheres in a few
+// materials, then loads it to measure parse and build throughput
+static void bench_scene_file()
+{
+	constexpr int grid_size = 1000;
+	const std::string path =
+		(std::filesystem::temp_directory_path() / "raytracer_bench.scene").string();
+
+	FILE* f = std::fopen(path.c_str(), "w");
+	std::fprintf(f, "camera lookfrom 0 400 800 lookat 0 0 0 vfov 60\n");
+	std::fprintf(f, "texture checker checker 0.9 0.9 0.9 0.2 0.3 0.1\n");
+	std::fprintf(f, "material ground lambertian checker\n");
+	std::fprintf(f, "material matte lambertian 0.65 0.05 0.05\n");
+	std::fprintf(f, "material steel metal 0.7 0.6 0.5 0.1\n");
+	std::fprintf(f, "material glass dielectric 1.5\n");
+	std::fprintf(f, "sphere 0 -100000 0 100000 ground\n");
+	const char* materials[] = {"matte", "steel", "glass"};
+	for(int i = 0; i < grid_size; i++)
+	{
+		for(int j = 0; j < grid_size; j++)
+		{
+			std::fprintf(f,
+						 "sphere %f 0.3 %f 0.3 %s\n",
+						 i - 0.5f * grid_size,
+						 j - 0.5f * grid_size,
+						 materials[(i + j) % 3]);
+		}
+	}
+	std::fclose(f);
+
+	SceneLoader::Stats stats;
+	{
+		Scene scene;
+		std::cout << "without a cache\n";
+		if(SceneLoader::load(path, scene, &stats)) stats.print(std::cout);
+	}
+
+	// the second load maps in the BVH the first one wrote
+	const std::string cache_directory = std::filesystem::temp_directory_path().string();
+	const std::string cache_path = SceneLoader::cache_path(cache_directory, path);
+	std::remove(cache_path.c_str());
+	for(const char* title : {"building the cache", "from the cache"})
+	{
+		Scene scene;
+		std::cout << title << "\n";
+		if(!SceneLoader::load(path, scene, &stats, cache_directory)) break;
+		stats.print(std::cout);
+		trace_primary_rays("  traversal", *scene.world, Camera(scene.camera, 1.f), 1000000);
+	}
+
+	std::remove(path.c_str());
+	std::remove(cache_path.c_str());
+}
+
+int main(int argc, char** argv)
+{
+	const std::pair<const char*, void (*)()> benchmarks[] = {
+		{"bvh_split", bench_bvh_split},
+		{"bvh_layout", bench_bvh_layout},
+		{"bvh_wide", bench_bvh_wide},
+		{"bvh_build", bench_bvh_build},
+		{"occlusion", bench_occlusion},
+		{"shading", bench_shading},
+		{"mesh", bench_mesh},
+		{"bvh_morton", bench_bvh_morton},
+		{"instancing", bench_instancing},
+		{"box", bench_box},
+		{"sampling", bench_sampling},
+		{"adaptive", bench_adaptive},
+		{"scene_file", bench_scene_file},
+	};
+
+	for(const auto& bench : benchmarks)
+	{
+		bool selected = argc < 2;
+		for(int i = 1; i < argc; i++) selected |= std::strcmp(argv[i], bench.first) == 0;
+		if(!selected) continue;
+
+		std::cout << "== " << bench.first << "\n";
+		bench.second();
+	}
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "hittable.h"
+#include "material.h"
+#include "sampler.h"
+#include "vec3.h"
+
+#include <memory>
+
+/*
+ *  The virtual Material and Texture hierarchy the renderer used before
+ *  materials became a variant, kept as the baseline for the shading
+ *  benchmark. Only the types random_scene() uses are here.
+ */
+
+namespace virtual_material
+{
+
+class Texture
+{
+public:
+	virtual ~Texture() = default;
+	virtual vec3 value(float u, float v, const vec3& p) const = 0;
+};
+
+class ConstantTexture : public Texture
+{
+public:
+	ConstantTexture(vec3 c)
+		: colour(c)
+	{}
+
+	virtual vec3 value(float u, float v, const vec3& p) const override { return colour; }
+
+private:
+	vec3 colour;
+};
+
+class CheckerTexture : public Texture
+{
+public:
+	CheckerTexture(std::shared_ptr<Texture> t0, std::shared_ptr<Texture> t1)
+		: even(t0)
+		, odd(t1)
+	{}
+
+	virtual vec3 value(float u, float v, const vec3& p) const override
+	{
+		float sines = sin(10.f * p.x()) * sin(10.f * p.y()) * sin(10.f * p.z());
+		if(sines < 0.f)
+			return odd->value(u, v, p);
+		else
+			return even->value(u, v, p);
+	}
+
+private:
+	std::shared_ptr<Texture> even, odd;
+};
+
+class Material
+{
+public:
+	virtual ~Material() = default;
+	virtual bool scatter(const Ray& r_in,
+						 const HitRecord& rec,
+						 vec3& attenuation,
+						 Ray& scattered,
+						 Sampler& sampler) const = 0;
+	virtual bool is_specular() const { return true; }
+	virtual vec3 eval(const Ray& r_in, const HitRecord& rec, const vec3& direction) const
+	{
+		return vec3(0.f, 0.f, 0.f);
+	}
+};
+
+class Lambertian : public Material
+{
+public:
+	Lambertian(std::shared_ptr<Texture> a)
+		: albedo(a)
+	{}
+
+	virtual bool scatter(const Ray& r_in,
+						 const HitRecord& rec,
+						 vec3& attenuation,
+						 Ray& scattered,
+						 Sampler& sampler) const override
+	{
+		vec3 direction = rec.normal + random_unit_vector(sampler);
+		if(direction.squared_length() < 1e-8f) direction = rec.normal;
+
+		scattered = Ray(rec.p, direction, r_in.time());
+		attenuation = albedo->value(rec.u, rec.v, rec.p);
+		return true;
+	}
+
+	virtual bool is_specular() const override { return false; }
+
+	virtual vec3 eval(const Ray& r_in, const HitRecord& rec, const vec3& direction) const override
+	{
+		float cosine = dot(rec.normal, direction) / direction.length();
+		float pdf = cosine > 0.f ? cosine / static_cast<float>(M_PI) : 0.f;
+		return albedo->value(rec.u, rec.v, rec.p) * pdf;
+	}
+
+private:
+	std::shared_ptr<Texture> albedo;
+};
+
+class Metal : public Material
+{
+public:
+	Metal(const vec3& a, float f)
+		: albedo(a)
+		, fuzz(f < 1.f ? f : 1.f)
+	{}
+
+	virtual bool scatter(const Ray& r_in,
+						 const HitRecord& rec,
+						 vec3& attenuation,
+						 Ray& scattered,
+						 Sampler& sampler) const override
+	{
+		vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
+		scattered = Ray(rec.p, reflected + fuzz * random_in_unit_sphere(sampler));
+		attenuation = albedo;
+
+		return (dot(scattered.direction(), rec.normal) > 0);
+	}
+
+private:
+	vec3 albedo;
+	float fuzz;
+};
+
+class Dielectric : public Material
+{
+public:
+	Dielectric(float ri)
+		: ref_idx(ri)
+	{}
+
+	virtual bool scatter(const Ray& r_in,
+						 const HitRecord& rec,
+						 vec3& attenuation,
+						 Ray& scattered,
+						 Sampler& sampler) const override
+	{
+		vec3 outward_normal, refracted;
+		vec3 reflected = reflect(r_in.direction(), rec.normal);
+		float ni_over_nt, reflected_prob, cosine;
+		attenuation = vec3(1.f, 1.f, 1.f);
+
+		if(dot(r_in.direction(), rec.normal) > 0.f)
+		{
+			outward_normal = -rec.normal;
+			ni_over_nt = ref_idx;
+			cosine = ref_idx * dot(r_in.direction(), rec.normal) / r_in.direction().length();
+		}
+		else
+		{
+			outward_normal = rec.normal;
+			ni_over_nt = 1.f / ref_idx;
+			cosine = -dot(r_in.direction(), rec.normal) / r_in.direction().length();
+		}
+
+		if(refract(r_in.direction(), outward_normal, ni_over_nt, refracted))
+			reflected_prob = schlick(cosine, ref_idx);
+		else
+			reflected_prob = 1.f;
+
+		if(sampler.next_float() < reflected_prob)
+			scattered = Ray(rec.p, reflected);
+		else
+			scattered = Ray(rec.p, refracted);
+
+		return true;
+	}
+
+private:
+	float ref_idx;
+};
+
+} // namespace virtual_material
@@ -3,6 +3,8 @@
 #include "ray.h"
 #include "vec3.h"
 
+#include <limits>
+
 inline float ffmin(float a, float b) { return a < b ? a : b; }
 inline float ffmax(float a, float b) { return a > b ? a : b; }
 
@@ -11,37 +13,70 @@ class AABB
 public:
 	AABB() = default;
 	AABB(const vec3& a, const vec3& b)
-		: _min(a)
-		, _max(b)
+		: bounds{a, b}
 	{}
 
-	vec3 min() const { return _min; }
-	vec3 max() const { return _max; }
+	// an inverted box which any call to grow() will replace
+	static AABB empty()
+	{
+		constexpr float inf = std::numeric_limits<float>::infinity();
+		return AABB(vec3(inf, inf, inf), vec3(-inf, -inf, -inf));
+	}
 
-	bool hit(const Ray& r, float tmin, float tmax) const
+	const vec3& min() const { return bounds[0]; }
+	const vec3& max() const { return bounds[1]; }
+	vec3 centroid() const { return 0.5f * (bounds[0] + bounds[1]); }
+
+	float surface_area() const
+	{
+		vec3 d = bounds[1] - bounds[0];
+		return 2.f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+	}
+
+	void grow(const AABB& b)
 	{
 		for(int a = 0; a < 3; a++)
 		{
-			//float t0 = ffmin((_min[a] - r.origin()[a]) / r.direction()[a],
-			//				 (_max[a] - r.origin()[a]) / r.direction()[a]);
-			//float t1 = ffmax((_min[a] - r.origin()[a]) / r.direction()[a],
-			//				 (_max[a] - r.origin()[a]) / r.direction()[a]);
-			//tmin = ffmax(t0, tmin);
-			//tmax = ffmin(t1, tmax);
+			bounds[0][a] = ffmin(bounds[0][a], b.bounds[0][a]);
+			bounds[1][a] = ffmax(bounds[1][a], b.bounds[1][a]);
+		}
+	}
 
-			float invD = 1.f / r.direction()[a];
-			float t0 = (min()[a] - r.origin()[a]) * invD;
-			float t1 = (max()[a] - r.origin()[a]) * invD;
+	void grow(const vec3& p)
+	{
+		for(int a = 0; a < 3; a++)
+		{
+			bounds[0][a] = ffmin(bounds[0][a], p[a]);
+			bounds[1][a] = ffmax(bounds[1][a], p[a]);
+		}
+	}
 
-			if(invD < 0.f) std::swap(t0, t1);
+	/*
+	 *  Branchless slab test. The ray's direction signs pick the near and far
+	 *  plane on each axis, so each axis costs two subtract-multiplies against
+	 *  the ray's precomputed 1 / direction plus a min and a max. On an axis
+	 *  the ray is parallel to, both distances are infinities of the same sign
+	 *  when the origin is outside the slab, which culls the box. They are only
+	 *  NaN (0 * inf) when the origin lies in one of the slab's planes; ffmin
+	 *  and ffmax keep their second argument when the compare fails, so that
+	 *  axis is then ignored.
+	 */
+	bool hit(const Ray& r, float tmin, float tmax) const
+	{
+		const vec3& org = r.origin();
+		const vec3& inv_dir = r.inv_direction();
 
-			tmin = t0 > tmin ? t0 : tmin;
-			tmax = t1 < tmax ? t1 : tmax;
+		float tx0 = (bounds[r.sign(0)].x() - org.x()) * inv_dir.x();
+		float tx1 = (bounds[1 - r.sign(0)].x() - org.x()) * inv_dir.x();
+		float ty0 = (bounds[r.sign(1)].y() - org.y()) * inv_dir.y();
+		float ty1 = (bounds[1 - r.sign(1)].y() - org.y()) * inv_dir.y();
+		float tz0 = (bounds[r.sign(2)].z() - org.z()) * inv_dir.z();
+		float tz1 = (bounds[1 - r.sign(2)].z() - org.z()) * inv_dir.z();
 
-			if(tmax <= tmin) return false;
-		}
+		tmin = ffmax(tz0, ffmax(ty0, ffmax(tx0, tmin)));
+		tmax = ffmin(tz1, ffmin(ty1, ffmin(tx1, tmax)));
 
-		return true;
+		return tmin < tmax;
 	}
 
 	static AABB surrounding_box(AABB box0, AABB box1)
@@ -49,13 +84,13 @@ public:
 		vec3 small(fmin(box0.min().x(), box1.min().x()),
 				   fmin(box0.min().y(), box1.min().y()),
 				   fmin(box0.min().z(), box1.min().z()));
-		vec3 big(fmin(box0.max().x(), box1.max().x()),
-				 fmin(box0.max().y(), box1.max().y()),
-				 fmin(box0.max().z(), box1.max().z()));
+		vec3 big(fmax(box0.max().x(), box1.max().x()),
+				 fmax(box0.max().y(), box1.max().y()),
+				 fmax(box0.max().z(), box1.max().z()));
 
 		return AABB(small, big);
 	}
 
 private:
-	vec3 _min, _max;
+	vec3 bounds[2]; // min, max - indexed by the ray direction sign in hit()
 };
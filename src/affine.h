@@ -0,0 +1,134 @@
+#pragma once
+
+#include "aabb.h"
+#include "vec3.h"
+
+#include <cmath>
+
+/*
+ *  Affine transform stored as the top three rows of a 4x4 matrix: a 3x3
+ *  linear part and a translation in the last column. Transforms combine
+ *  with operator*, which applies the right hand side first.
+ */
+
+class Affine
+{
+public:
+	Affine()
+		: m{{1.f, 0.f, 0.f, 0.f}, {0.f, 1.f, 0.f, 0.f}, {0.f, 0.f, 1.f, 0.f}}
+	{}
+
+	static Affine translation(const vec3& offset)
+	{
+		Affine a;
+		for(int i = 0; i < 3; i++) a.m[i][3] = offset[i];
+		return a;
+	}
+
+	static Affine scaling(const vec3& scale)
+	{
+		Affine a;
+		for(int i = 0; i < 3; i++) a.m[i][i] = scale[i];
+		return a;
+	}
+
+	// counter-clockwise looking down the axis, which needn't be normalised
+	static Affine rotation(const vec3& axis, float degrees)
+	{
+		const vec3 n = unit_vector(axis);
+		const float radians = (static_cast<float>(M_PI) / 180.f) * degrees;
+		const float c = cos(radians), s = sin(radians), t = 1.f - c;
+
+		Affine a;
+		a.m[0][0] = t * n.x() * n.x() + c;
+		a.m[0][1] = t * n.x() * n.y() - s * n.z();
+		a.m[0][2] = t * n.x() * n.z() + s * n.y();
+		a.m[1][0] = t * n.x() * n.y() + s * n.z();
+		a.m[1][1] = t * n.y() * n.y() + c;
+		a.m[1][2] = t * n.y() * n.z() - s * n.x();
+		a.m[2][0] = t * n.x() * n.z() - s * n.y();
+		a.m[2][1] = t * n.y() * n.z() + s * n.x();
+		a.m[2][2] = t * n.z() * n.z() + c;
+		return a;
+	}
+
+	static Affine rotation_y(float degrees) { return rotation(vec3(0.f, 1.f, 0.f), degrees); }
+
+	Affine operator*(const Affine& b) const
+	{
+		Affine a;
+		for(int i = 0; i < 3; i++)
+		{
+			for(int j = 0; j < 4; j++)
+			{
+				a.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j];
+				if(j == 3) a.m[i][j] += m[i][3];
+			}
+		}
+		return a;
+	}
+
+	vec3 point(const vec3& p) const { return vector(p) + vec3(m[0][3], m[1][3], m[2][3]); }
+
+	vec3 vector(const vec3& v) const
+	{
+		return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+					m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+					m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+	}
+
+	// multiplies by the transpose of the linear part; normals are transformed
+	// by the inverse transpose, so call this on the inverse transform
+	vec3 transposed_vector(const vec3& v) const
+	{
+		return vec3(m[0][0] * v.x() + m[1][0] * v.y() + m[2][0] * v.z(),
+					m[0][1] * v.x() + m[1][1] * v.y() + m[2][1] * v.z(),
+					m[0][2] * v.x() + m[1][2] * v.y() + m[2][2] * v.z());
+	}
+
+	// the linear part must be invertible
+	Affine inverse() const
+	{
+		const float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+		const float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+		const float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+		const float inv_det = 1.f / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+
+		Affine a;
+		a.m[0][0] = c00 * inv_det;
+		a.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+		a.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+		a.m[1][0] = c01 * inv_det;
+		a.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+		a.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+		a.m[2][0] = c02 * inv_det;
+		a.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+		a.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+		const vec3 t = a.vector(vec3(m[0][3], m[1][3], m[2][3]));
+		for(int i = 0; i < 3; i++) a.m[i][3] = -t[i];
+		return a;
+	}
+
+	// bounds of the transformed box, without transforming all eight corners
+	AABB box(const AABB& b) const
+	{
+		if(b.min().x() > b.max().x()) return b; // empty
+
+		vec3 lo(m[0][3], m[1][3], m[2][3]), hi = lo;
+		for(int i = 0; i < 3; i++)
+		{
+			for(int j = 0; j < 3; j++)
+			{
+				const float e = m[i][j] * b.min()[j];
+				const float f = m[i][j] * b.max()[j];
+				lo[i] += ffmin(e, f);
+				hi[i] += ffmax(e, f);
+			}
+		}
+		return AABB(lo, hi);
+	}
+
+private:
+	float m[3][4];
+};
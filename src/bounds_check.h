@@ -0,0 +1,81 @@
+#pragma once
+
+#include "aabb.h"
+#include "hittable.h"
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <typeinfo>
+#include <utility>
+
+/*
+ *  Debug wrapper checking that every hit on an object lies inside the box
+ *  the object reports for the scene's shutter interval. A box that is too
+ *  small makes a BVH silently cull parts of the object, so scenes are built
+ *  with each object wrapped in one of these, in a plain list, when
+ *  RAYTRACER_VALIDATE_BOUNDS is defined. Each object reports its first bad
+ *  hit only.
+ */
+
+class BoundsCheck : public Hittable
+{
+public:
+	BoundsCheck(std::shared_ptr<Hittable> p, float time0, float time1)
+		: ptr(std::move(p))
+	{
+		has_box = ptr->bounding_box(time0, time1, box);
+		if(!has_box) std::cerr << "No bounding box for " << typeid(*ptr).name() << "\n";
+	}
+
+	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
+	{
+		if(!ptr->hit(r, t_min, t_max, rec)) return false;
+
+		const vec3 p = r.point_at_parameter(rec.t);
+		if(has_box && !inside(p) && !reported.exchange(true))
+		{
+			std::cerr << "Hit at " << p << " outside the bounding box " << box.min() << " - "
+					  << box.max() << " of " << typeid(*ptr).name() << "\n";
+		}
+		return true;
+	}
+
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		return ptr->occluded(r, t_min, t_max);
+	}
+
+	virtual bool bounding_box(float t0, float t1, AABB& b) const override
+	{
+		return ptr->bounding_box(t0, t1, b);
+	}
+
+	virtual float pdf_value(const vec3& origin, const vec3& direction) const override
+	{
+		return ptr->pdf_value(origin, direction);
+	}
+
+	virtual vec3 random(const vec3& origin, Sampler& sampler) const override
+	{
+		return ptr->random(origin, sampler);
+	}
+
+private:
+	// allows for rounding in the hit point, which grows with its distance from the origin
+	bool inside(const vec3& p) const
+	{
+		for(int a = 0; a < 3; a++)
+		{
+			const float slack = 1e-4f * (1.f + fabs(p[a]));
+			if(p[a] < box.min()[a] - slack || p[a] > box.max()[a] + slack) return false;
+		}
+		return true;
+	}
+
+	std::shared_ptr<Hittable> ptr;
+	AABB box;
+	bool has_box;
+	mutable std::atomic<bool> reported{false};
+};
@@ -1,52 +1,118 @@
 #pragma once
 
 #include "aabb.h"
-#include "flip_normals.h"
-#include "hittable_list.h"
-#include "material.h"
-#include "rect.h"
+#include "hittable.h"
 #include "vec3.h"
 
-#include <memory>
-#include <vector>
+#include <limits>
+
+/*
+ *  Axis aligned box intersected directly with the slab test rather than as
+ *  six rectangles. The face the ray enters through (or leaves through, for
+ *  a ray starting inside) is the one hit; it is recorded as the primitive,
+ *  2 * axis plus 1 for the max side, and the uv is worked out on that face
+ *  the same way the matching rectangle would.
+ */
 
 class Box : public Hittable
 {
 public:
     Box() = default;
-    Box(const vec3& p0, const vec3& p1, std::shared_ptr<Material> mat)
-        : pmin(p0)
-        , pmax(p1)
+    Box(const vec3& p0, const vec3& p1, MaterialId mat)
+        : bounds{p0, p1}
+        , material(mat)
+    {}
+
+    virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
     {
-        constexpr int list_size = 6;
-        hittables_vec list;
-        list.reserve(list_size);
-
-        list.emplace_back(std::make_shared<XYRect>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), mat));
-        list.emplace_back(std::make_shared<FlipNormals>(
-            std::make_shared<XYRect>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), mat)));
-        list.emplace_back(std::make_shared<XZRect>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), mat));
-        list.emplace_back(std::make_shared<FlipNormals>(
-            std::make_shared<XZRect>(p0.x(), p1.x(), p0.z(), p1.z(), p0.x(), mat)));
-        list.emplace_back(std::make_shared<YZRect>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), mat));
-        list.emplace_back(std::make_shared<FlipNormals>(
-            std::make_shared<YZRect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), mat)));
-
-        list_ptr = std::make_shared<HittableList>(list, list_size);
+        float t_near, t_far;
+        int near_axis, far_axis;
+        if(!slabs(r, t_near, t_far, near_axis, far_axis)) return false;
+
+        float t;
+        int face;
+        if(t_near > t_min && t_near < t_max)
+        {
+            t = t_near;
+            face = 2 * near_axis + r.sign(near_axis); // entering through the max side if going down
+        }
+        else if(t_far > t_min && t_far < t_max)
+        {
+            t = t_far;
+            face = 2 * far_axis + 1 - r.sign(far_axis);
+        }
+        else
+        {
+            return false;
+        }
+
+        const int axis = face / 2, side = face % 2;
+        vec3 normal(0.f, 0.f, 0.f);
+        normal[axis] = side ? 1.f : -1.f;
+
+        rec.t = t;
+        rec.normal = normal;
+        rec.local = r.point_at_parameter(t);
+        rec.local[axis] = bounds[side][axis]; // exactly on the face
+        rec.object = this;
+        rec.primitive = static_cast<uint32_t>(face);
+        return true;
     }
 
-    virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
+    virtual bool occluded(const Ray& r, float t_min, float t_max) const override
     {
-        return list_ptr->hit(r, t_min, t_max, rec);
+        float t_near, t_far;
+        int near_axis, far_axis;
+        if(!slabs(r, t_near, t_far, near_axis, far_axis)) return false;
+
+        return (t_near > t_min && t_near < t_max) || (t_far > t_min && t_far < t_max);
+    }
+
+    // x faces are parameterised by y and z, y faces by x and z and z faces by x and y
+    virtual void surface(HitRecord& rec) const override
+    {
+        const int axis = static_cast<int>(rec.primitive) / 2;
+        const int a = axis == 0 ? 1 : 0;
+        const int b = axis == 2 ? 1 : 2;
+        rec.u = (rec.local[a] - bounds[0][a]) / (bounds[1][a] - bounds[0][a]);
+        rec.v = (rec.local[b] - bounds[0][b]) / (bounds[1][b] - bounds[0][b]);
+        rec.material = material;
     }
 
     virtual bool bounding_box(float t0, float t1, AABB& box) const override
     {
-        box = AABB(pmin, pmax);
+        box = AABB(bounds[0], bounds[1]);
         return true;
     }
 
 private:
-    vec3 pmin, pmax;
-    std::shared_ptr<HittableList> list_ptr;
+    // the ray's parameters where it enters and leaves the box and the axes
+    // of those planes; (bound - origin) / direction keeps a ray parallel to
+    // a slab outside it at an infinite distance rather than NaN
+    bool slabs(const Ray& r, float& t_near, float& t_far, int& near_axis, int& far_axis) const
+    {
+        t_near = -std::numeric_limits<float>::infinity();
+        t_far = std::numeric_limits<float>::infinity();
+        near_axis = far_axis = 0;
+        for(int a = 0; a < 3; a++)
+        {
+            const float t0 = (bounds[r.sign(a)][a] - r.origin()[a]) * r.inv_direction()[a];
+            const float t1 = (bounds[1 - r.sign(a)][a] - r.origin()[a]) * r.inv_direction()[a];
+            if(t0 > t_near)
+            {
+                t_near = t0;
+                near_axis = a;
+            }
+            if(t1 < t_far)
+            {
+                t_far = t1;
+                far_axis = a;
+            }
+        }
+
+        return t_near <= t_far;
+    }
+
+    vec3 bounds[2]; // min, max - indexed by the ray direction sign in slabs()
+    MaterialId material;
 };
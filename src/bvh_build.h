@@ -0,0 +1,378 @@
+#pragma once
+
+#include "aabb.h"
+#include "parallel.h"
+#include "vec3.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+/*
+ *  Helpers shared by the BVH builders: the split strategies, a binned
+ *  surface area heuristic and a report describing the quality of a tree.
+ */
+
+enum class BVHSplit
+{
+	Median, // random axis, split at the median object
+	SAH, // binned surface area heuristic over all three axes
+	Morton // sorted along a Morton curve, split where the codes' top bit changes
+};
+
+// relative costs used by the surface area heuristic
+constexpr float bvh_traversal_cost = 1.f;
+constexpr float bvh_intersection_cost = 1.f;
+
+// what the builders need to know about a primitive
+struct BVHBuildPrimitive
+{
+	AABB box;
+	vec3 centroid;
+	int index; // position of the primitive in the original list
+};
+
+// primitives per thread below which binning a range isn't worth threads
+constexpr int bvh_parallel_grain = 1 << 15;
+
+// splits prims[begin, end) into up to num_threads chunks of at least
+// bvh_parallel_grain, calls f(chunk_begin, chunk_end, result) for each on
+// its own thread and returns the results combined in order by merge
+template <typename T, typename F, typename Merge>
+T bvh_parallel_reduce(
+	int begin, int end, unsigned num_threads, const T& init, F&& f, Merge&& merge)
+{
+	const int n = end - begin;
+	const size_t num_chunks =
+		std::max(1, std::min(static_cast<int>(num_threads), n / bvh_parallel_grain));
+	if(num_chunks == 1)
+	{
+		T result = init;
+		f(begin, end, result);
+		return result;
+	}
+
+	std::vector<T> results(num_chunks, init);
+	parallel_for(num_chunks, [&](size_t i) {
+		f(begin + static_cast<int>(n * i / num_chunks),
+		  begin + static_cast<int>(n * (i + 1) / num_chunks),
+		  results[i]);
+	});
+
+	T result = init;
+	for(const T& r : results) merge(result, r);
+	return result;
+}
+
+inline AABB bvh_centroid_bounds(const std::vector<BVHBuildPrimitive>& prims,
+								int begin,
+								int end,
+								unsigned num_threads = 1)
+{
+	return bvh_parallel_reduce(
+		begin,
+		end,
+		num_threads,
+		AABB::empty(),
+		[&](int b, int e, AABB& bounds) {
+			for(int i = b; i < e; i++) bounds.grow(prims[i].centroid);
+		},
+		[](AABB& bounds, const AABB& other) { bounds.grow(other); });
+}
+
+/*
+ *  Partitions prims[begin, end) using a binned SAH and returns the index of
+ *  the first primitive of the right half. Always returns a split with at least
+ *  one primitive on each side, falling back to the middle when every centroid
+ *  is in the same place. axis receives the split axis and cost the sum of
+ *  primitive count * surface area over both halves (max float for a fallback).
+ *  Large ranges are binned on up to num_threads threads; the bins, and so
+ *  the split, are the same however many are used.
+ */
+inline int bvh_sah_split(std::vector<BVHBuildPrimitive>& prims,
+						 int begin,
+						 int end,
+						 int& axis,
+						 float& cost,
+						 unsigned num_threads = 1)
+{
+	constexpr int num_bins = 16;
+
+	struct Bin
+	{
+		AABB box = AABB::empty();
+		int count = 0;
+	};
+
+	struct Bins
+	{
+		Bin bin[3][num_bins];
+	};
+
+	const AABB centroid_bounds = bvh_centroid_bounds(prims, begin, end, num_threads);
+
+	float lo[3], scale[3];
+	for(int a = 0; a < 3; a++)
+	{
+		lo[a] = centroid_bounds.min()[a];
+		const float extent = centroid_bounds.max()[a] - lo[a];
+		scale[a] = extent > 0.f ? num_bins / extent : 0.f;
+	}
+
+	const Bins bins = bvh_parallel_reduce(
+		begin,
+		end,
+		num_threads,
+		Bins(),
+		[&](int b, int e, Bins& local) {
+			for(int a = 0; a < 3; a++)
+			{
+				if(scale[a] == 0.f) continue;
+
+				for(int i = b; i < e; i++)
+				{
+					int bin = std::min(static_cast<int>((prims[i].centroid[a] - lo[a]) * scale[a]),
+									   num_bins - 1);
+					local.bin[a][bin].box.grow(prims[i].box);
+					local.bin[a][bin].count++;
+				}
+			}
+		},
+		[](Bins& total, const Bins& local) {
+			for(int a = 0; a < 3; a++)
+			{
+				for(int b = 0; b < num_bins; b++)
+				{
+					total.bin[a][b].box.grow(local.bin[a][b].box);
+					total.bin[a][b].count += local.bin[a][b].count;
+				}
+			}
+		});
+
+	float best_cost = std::numeric_limits<float>::max();
+	int best_axis = -1;
+	int best_bin = 0;
+
+	for(int a = 0; a < 3; a++)
+	{
+		if(scale[a] == 0.f) continue;
+
+		// sweep from the right to get the area and count of every right half
+		float right_area[num_bins];
+		int right_count[num_bins];
+		AABB right_box = AABB::empty();
+		int count = 0;
+		for(int b = num_bins - 1; b > 0; b--)
+		{
+			right_box.grow(bins.bin[a][b].box);
+			count += bins.bin[a][b].count;
+			right_area[b] = count > 0 ? right_box.surface_area() : 0.f;
+			right_count[b] = count;
+		}
+
+		// then from the left, evaluating the split after every bin
+		AABB left_box = AABB::empty();
+		count = 0;
+		for(int b = 0; b < num_bins - 1; b++)
+		{
+			left_box.grow(bins.bin[a][b].box);
+			count += bins.bin[a][b].count;
+			if(count == 0 || right_count[b + 1] == 0) continue;
+
+			float c = count * left_box.surface_area() + right_count[b + 1] * right_area[b + 1];
+			if(c < best_cost)
+			{
+				best_cost = c;
+				best_axis = a;
+				best_bin = b;
+			}
+		}
+	}
+
+	int mid = (begin + end) / 2;
+	axis = std::max(best_axis, 0);
+	cost = best_cost;
+	if(best_axis >= 0)
+	{
+		auto it = std::partition(
+			prims.begin() + begin, prims.begin() + end, [&](const BVHBuildPrimitive& p) {
+				int b = std::min(
+					static_cast<int>((p.centroid[best_axis] - lo[best_axis]) * scale[best_axis]),
+					num_bins - 1);
+				return b <= best_bin;
+			});
+		mid = static_cast<int>(it - prims.begin());
+	}
+
+	return mid;
+}
+
+/*
+ *  Linear BVH (Karras, "Maximizing Parallelism in the Construction of BVHs,
+ *  Octrees, and k-d Trees", 2012): the centroids are quantised to a 2^21
+ *  grid per axis and their bits interleaved into 63 bit Morton codes, so
+ *  sorting by code orders the primitives along a Z curve. Every range of
+ *  primitives sharing a code prefix is then a cell of the grid, split in
+ *  two by the next bit, which needs no look at the primitives themselves.
+ *  Builds take a sort and one pass, with trees worse than SAH ones.
+ */
+
+// spreads the low 21 bits of x out to every third bit
+inline uint64_t bvh_morton_spread(uint64_t x)
+{
+	x &= 0x1fffff;
+	x = (x | x << 32) & 0x1f00000000ffffull;
+	x = (x | x << 16) & 0x1f0000ff0000ffull;
+	x = (x | x << 8) & 0x100f00f00f00f00full;
+	x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+	x = (x | x << 2) & 0x1249249249249249ull;
+	return x;
+}
+
+// returns the order of boxes along a Morton curve through their centroids
+// and fills codes with their codes in that order. The sort is a radix sort
+// of the top 30 bits of the codes packed with the indices, three passes over
+// one array, after which boxes whose top bits tie are sorted on the rest.
+inline std::vector<uint32_t> bvh_morton_order(const std::vector<AABB>& boxes,
+											  std::vector<uint64_t>& codes)
+{
+	const size_t n = boxes.size();
+	AABB bounds = AABB::empty();
+	for(const AABB& box : boxes) bounds.grow(box.centroid());
+
+	float scale[3];
+	for(int a = 0; a < 3; a++)
+	{
+		const float extent = bounds.max()[a] - bounds.min()[a];
+		scale[a] = extent > 0.f ? 2097152.f / extent : 0.f;
+	}
+
+	std::vector<uint64_t> box_codes(n), keys(n), sorted_keys(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		const vec3 centroid = boxes[i].centroid();
+		uint64_t code = 0;
+		for(int a = 0; a < 3; a++)
+		{
+			const float q = (centroid[a] - bounds.min()[a]) * scale[a];
+			code = code << 1 | bvh_morton_spread(std::min(static_cast<uint32_t>(q), 0x1fffffu));
+		}
+		box_codes[i] = code;
+		keys[i] = (code >> 33) << 32 | i;
+	}
+
+	// least significant digit first, skipping digits every code has the same
+	constexpr int digit_bits = 10;
+	constexpr uint64_t digit_mask = (1u << digit_bits) - 1;
+	std::vector<uint32_t> count(1u << digit_bits);
+	for(int shift = 32; shift < 62; shift += digit_bits)
+	{
+		std::fill(count.begin(), count.end(), 0u);
+		for(uint64_t key : keys) count[(key >> shift) & digit_mask]++;
+		if(count[(keys[0] >> shift) & digit_mask] == n) continue;
+
+		uint32_t offset = 0;
+		for(uint32_t& c : count)
+		{
+			const uint32_t bucket_size = c;
+			c = offset;
+			offset += bucket_size;
+		}
+
+		for(uint64_t key : keys) sorted_keys[count[(key >> shift) & digit_mask]++] = key;
+		keys.swap(sorted_keys);
+	}
+
+	std::vector<uint32_t> order(n);
+	codes.resize(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		order[i] = static_cast<uint32_t>(keys[i]);
+		codes[i] = box_codes[order[i]];
+	}
+
+	for(size_t begin = 0, end; begin < n; begin = end)
+	{
+		for(end = begin + 1; end < n && (codes[end] >> 33) == (codes[begin] >> 33); end++)
+			;
+		if(end - begin == 1) continue;
+
+		std::sort(order.begin() + begin, order.begin() + end, [&](uint32_t a, uint32_t b) {
+			return box_codes[a] != box_codes[b] ? box_codes[a] < box_codes[b] : a < b;
+		});
+		for(size_t i = begin; i < end; i++) codes[i] = box_codes[order[i]];
+	}
+
+	return order;
+}
+
+// returns the index of the first primitive of Morton sorted codes[begin, end)
+// with the highest bit in which their codes differ set, and the axis of that
+// bit; the middle when every code is the same
+inline int bvh_morton_split(const std::vector<uint64_t>& codes, int begin, int end, int& axis)
+{
+	const uint64_t diff = codes[begin] ^ codes[end - 1];
+	if(diff == 0)
+	{
+		axis = 0;
+		return (begin + end) / 2;
+	}
+
+	int bit = 0;
+	for(int step = 32; step > 0; step /= 2)
+		if(diff >> (bit + step)) bit += step;
+
+	// codes hold x, y, z from the highest bit of each group of three down
+	axis = 2 - bit % 3;
+	const uint64_t mask = uint64_t(1) << bit;
+	auto it = std::partition_point(codes.begin() + begin,
+								   codes.begin() + end,
+								   [mask](uint64_t code) { return (code & mask) == 0; });
+	return static_cast<int>(it - codes.begin());
+}
+
+/*
+ *  Summary of a built tree. The SAH cost is the expected cost of tracing a
+ *  random ray through the tree relative to the root, in units of
+ *  bvh_traversal_cost and bvh_intersection_cost - lower is better.
+ */
+struct BVHStats
+{
+	int num_nodes = 0;
+	int num_leaves = 0;
+	int num_primitives = 0;
+	int max_depth = 0;
+	int min_leaf_size = std::numeric_limits<int>::max();
+	int max_leaf_size = 0;
+	float sah_cost = 0.f;
+
+	void add_interior(float area_ratio)
+	{
+		num_nodes++;
+		sah_cost += area_ratio * bvh_traversal_cost;
+	}
+
+	void add_leaf(float area_ratio, int size, int depth)
+	{
+		num_nodes++;
+		num_leaves++;
+		num_primitives += size;
+		max_depth = std::max(max_depth, depth);
+		min_leaf_size = std::min(min_leaf_size, size);
+		max_leaf_size = std::max(max_leaf_size, size);
+		sah_cost += area_ratio * (bvh_traversal_cost + size * bvh_intersection_cost);
+	}
+
+	void print(std::ostream& os) const
+	{
+		os << "  nodes:      " << num_nodes << "\n"
+		   << "  leaves:     " << num_leaves << "\n"
+		   << "  max depth:  " << max_depth << "\n"
+		   << "  leaf size:  min " << (num_leaves ? min_leaf_size : 0) << ", max "
+		   << max_leaf_size << ", avg "
+		   << (num_leaves ? float(num_primitives) / float(num_leaves) : 0.f) << "\n"
+		   << "  SAH cost:   " << sah_cost << "\n";
+	}
+};
@@ -0,0 +1,331 @@
+#pragma once
+
+#include "aabb.h"
+#include "bvh_build.h"
+#include "linear_bvh.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ *  File of LinearBVHs built for a scene, so rendering the same scene again
+ *  skips building them. Each BVH is keyed on a hash of the boxes it was
+ *  built over and how it was split, so a BVH is only reused for the same
+ *  input whatever changed in the rest of the scene.
+ *
+ *  The file is memory mapped and the BVHs used where they lie: nodes only
+ *  hold offsets, so there is nothing to parse or fix up, and pages are only
+ *  read once traversal touches them. The layout is
+ *
+ *    Header, Entry[num_entries], then the node and index arrays of each
+ *    entry, each aligned to 64 bytes
+ *
+ *  in the byte order of the machine that wrote it. The header holds a hash
+ *  of everything after it, and every tree is checked to only point inside
+ *  its own arrays before it is used. A file of a different version, byte
+ *  order or node layout, or which fails those checks, is ignored and
+ *  rewritten.
+ */
+
+class BVHCache : public BVHSource
+{
+public:
+	static constexpr uint32_t version = 2;
+
+	// reads the file at path if it exists; save() writes back to it
+	explicit BVHCache(std::string path)
+		: _path(std::move(path))
+	{
+		auto file = std::make_shared<MappedFile>(_path);
+		if(!file->is_open()) return;
+
+		if(!read(*file))
+		{
+			std::cerr << "Ignoring BVH cache " << _path << ", it is out of date or damaged\n";
+			cached.clear();
+			return;
+		}
+
+		mapping = std::move(file);
+	}
+
+	virtual LinearBVH build(const std::vector<AABB>& boxes, BVHSplit split) override
+	{
+		static_assert(sizeof(AABB) == 6 * sizeof(float), "boxes are hashed as plain memory");
+		const uint64_t key = hash(boxes.data(), boxes.size() * sizeof(AABB), 1 + uint64_t(split));
+
+		LinearBVH bvh;
+		auto found = cached.find(key);
+		if(found != cached.end() && valid_indices(found->second, boxes.size()))
+		{
+			const Entry& e = found->second;
+			const char* base = mapping->data();
+			bvh = LinearBVH(mapping,
+							reinterpret_cast<const LinearBVHNode*>(base + e.nodes_offset),
+							e.num_nodes,
+							reinterpret_cast<const uint32_t*>(base + e.indices_offset),
+							e.num_indices);
+			_hits++;
+		}
+		else
+		{
+			bvh = LinearBVH(boxes, split);
+			_misses++;
+		}
+
+		if(used_keys.emplace(key, used.size()).second) used.push_back({key, bvh});
+		return bvh;
+	}
+
+	size_t hits() const { return _hits; }
+	size_t misses() const { return _misses; }
+	const std::string& path() const { return _path; }
+
+	// writes the BVHs asked for since the cache was opened, if any of them
+	// had to be built, then lets go of its copies of them. The file is
+	// written beside the old one and renamed over it, so the old one stays
+	// mapped and readers never see half a file.
+	bool save()
+	{
+		if(_misses == 0) return true;
+
+		std::vector<Entry> entries(used.size());
+		uint64_t offset = aligned(sizeof(Header) + entries.size() * sizeof(Entry));
+		for(size_t i = 0; i < used.size(); i++)
+		{
+			const LinearBVH& bvh = used[i].second;
+			entries[i].key = used[i].first;
+			entries[i].num_nodes = bvh.num_nodes();
+			entries[i].num_indices = bvh.num_primitive_indices();
+			entries[i].nodes_offset = offset;
+			offset = aligned(offset + entries[i].num_nodes * sizeof(LinearBVHNode));
+			entries[i].indices_offset = offset;
+			offset = aligned(offset + entries[i].num_indices * sizeof(uint32_t));
+		}
+
+		Header header;
+		header.num_entries = entries.size();
+		header.file_size = offset;
+
+		uint64_t checksum = hash(entries.data(), entries.size() * sizeof(Entry));
+		for(size_t i = 0; i < used.size(); i++)
+		{
+			const LinearBVH& bvh = used[i].second;
+			const uint64_t nodes_size = entries[i].num_nodes * sizeof(LinearBVHNode);
+			const uint64_t indices_size = entries[i].num_indices * sizeof(uint32_t);
+			checksum = hash(bvh.node_array(), nodes_size, checksum);
+			checksum = hash(bvh.primitive_indices(), indices_size, checksum);
+		}
+		header.checksum = checksum;
+
+		const std::string temp_path = _path + ".tmp";
+		std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+		if(!out)
+		{
+			std::cerr << "Could not write BVH cache " << temp_path << "\n";
+			return false;
+		}
+
+		// writes data at offset at, padding with zeros up to it
+		uint64_t written = 0;
+		auto write = [&](const void* data, uint64_t size, uint64_t at) {
+			static const char zeros[64] = {};
+			while(written < at)
+			{
+				const uint64_t n = std::min<uint64_t>(sizeof(zeros), at - written);
+				out.write(zeros, static_cast<std::streamsize>(n));
+				written += n;
+			}
+			out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			written += size;
+		};
+
+		write(&header, sizeof(header), 0);
+		write(entries.data(), entries.size() * sizeof(Entry), sizeof(header));
+		for(size_t i = 0; i < used.size(); i++)
+		{
+			const LinearBVH& bvh = used[i].second;
+			write(bvh.node_array(),
+				  entries[i].num_nodes * sizeof(LinearBVHNode),
+				  entries[i].nodes_offset);
+			write(bvh.primitive_indices(),
+				  entries[i].num_indices * sizeof(uint32_t),
+				  entries[i].indices_offset);
+		}
+		write(nullptr, 0, offset);
+		out.close();
+		used.clear();
+		used_keys.clear();
+
+		if(!out || std::rename(temp_path.c_str(), _path.c_str()) != 0)
+		{
+			std::cerr << "Could not write BVH cache " << _path << "\n";
+			std::remove(temp_path.c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+	// 64 bit hash of a block of memory, eight bytes at a time
+	static uint64_t hash(const void* data, size_t size, uint64_t seed = 0)
+	{
+		const char* p = static_cast<const char*>(data);
+		uint64_t h = mix(seed ^ (size * 0x9e3779b97f4a7c15ull));
+		for(; size >= 8; p += 8, size -= 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, p, 8);
+			h = (h ^ word) * 0x9fb21c651e98df25ull;
+			h ^= h >> 29;
+		}
+
+		uint64_t tail = 0;
+		std::memcpy(&tail, p, size);
+		return mix(h ^ tail);
+	}
+
+private:
+	struct Header
+	{
+		char magic[8] = {'R', 'T', 'B', 'V', 'H', 'C', 'A', 'C'};
+		uint32_t version = BVHCache::version;
+		uint32_t byte_order = 0x01020304;
+		uint32_t node_size = sizeof(LinearBVHNode);
+		uint32_t num_entries = 0;
+		uint64_t file_size = 0;
+		uint64_t checksum = 0; // hash of the entries, then of each entry's arrays
+	};
+
+	struct Entry
+	{
+		uint64_t key = 0;
+		uint64_t nodes_offset = 0;
+		uint64_t indices_offset = 0;
+		uint64_t num_nodes = 0;
+		uint64_t num_indices = 0;
+	};
+
+	static uint64_t aligned(uint64_t offset) { return (offset + 63) & ~uint64_t(63); }
+
+	static uint64_t mix(uint64_t z)
+	{
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	// checks everything the entries point at lies inside the file, that it
+	// hashes to the header's checksum and that every tree is well formed
+	bool read(const MappedFile& file)
+	{
+		if(file.size() < sizeof(Header)) return false;
+
+		Header header;
+		const Header expected;
+		std::memcpy(&header, file.data(), sizeof(header));
+		if(std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+		   header.version != expected.version || header.byte_order != expected.byte_order ||
+		   header.node_size != expected.node_size || header.file_size != file.size())
+			return false;
+
+		const uint64_t size = file.size();
+		if(header.num_entries > (size - sizeof(Header)) / sizeof(Entry)) return false;
+
+		std::vector<Entry> entries(header.num_entries);
+		std::memcpy(entries.data(), file.data() + sizeof(Header), entries.size() * sizeof(Entry));
+		uint64_t checksum = hash(entries.data(), entries.size() * sizeof(Entry));
+		for(const Entry& e : entries)
+		{
+			if(e.nodes_offset % 64 || e.indices_offset % 64 || e.nodes_offset > size ||
+			   e.indices_offset > size ||
+			   e.num_nodes > (size - e.nodes_offset) / sizeof(LinearBVHNode) ||
+			   e.num_indices > (size - e.indices_offset) / sizeof(uint32_t))
+				return false;
+
+			const uint64_t nodes_size = e.num_nodes * sizeof(LinearBVHNode);
+			const uint64_t indices_size = e.num_indices * sizeof(uint32_t);
+			checksum = hash(file.data() + e.nodes_offset, nodes_size, checksum);
+			checksum = hash(file.data() + e.indices_offset, indices_size, checksum);
+		}
+		if(checksum != header.checksum) return false;
+
+		for(const Entry& e : entries)
+		{
+			const auto* nodes =
+				reinterpret_cast<const LinearBVHNode*>(file.data() + e.nodes_offset);
+			if(!valid_tree(nodes, e.num_nodes, e.num_indices)) return false;
+
+			cached.emplace(e.key, e);
+		}
+
+		return true;
+	}
+
+	// checks traversal stays inside the arrays: interior nodes' children come
+	// after them in the array, trees are no deeper than the traversal stack
+	// and leaves only cover primitive indices which exist
+	static bool valid_tree(const LinearBVHNode* nodes, uint64_t num_nodes, uint64_t num_indices)
+	{
+		if(num_nodes == 0) return true;
+
+		// every node is reached once from the root at depth 1
+		std::vector<std::pair<uint64_t, int>> stack = {{0, 1}};
+		uint64_t num_reached = 0;
+		while(!stack.empty())
+		{
+			const auto [index, depth] = stack.back();
+			stack.pop_back();
+			if(++num_reached > num_nodes) return false;
+
+			const LinearBVHNode& node = nodes[index];
+			if(node.num_primitives > 0)
+			{
+				const uint64_t end = uint64_t(node.primitives_offset) + node.num_primitives;
+				if(end > num_indices) return false;
+				continue;
+			}
+
+			if(depth >= LinearBVH::max_depth || index + 1 >= num_nodes ||
+			   node.second_child_offset <= index + 1 || node.second_child_offset >= num_nodes)
+				return false;
+
+			stack.push_back({node.second_child_offset, depth + 1});
+			stack.push_back({index + 1, depth + 1});
+		}
+
+		return true;
+	}
+
+	// checks the leaves of a cached tree only refer to primitives there are
+	bool valid_indices(const Entry& e, size_t num_primitives) const
+	{
+		if(e.num_indices != num_primitives) return false;
+
+		const auto* indices = reinterpret_cast<const uint32_t*>(mapping->data() + e.indices_offset);
+		for(uint64_t i = 0; i < e.num_indices; i++)
+			if(indices[i] >= num_primitives) return false;
+		return true;
+	}
+
+private:
+	std::string _path;
+	std::shared_ptr<const MappedFile> mapping;
+	std::unordered_map<uint64_t, Entry> cached;
+
+	// every BVH handed out, in order, to be written by save()
+	std::vector<std::pair<uint64_t, LinearBVH>> used;
+	std::unordered_map<uint64_t, size_t> used_keys;
+	size_t _hits = 0;
+	size_t _misses = 0;
+};
@@ -1,141 +1,204 @@
 #pragma once
 
 #include "aabb.h"
+#include "bvh_build.h"
 #include "hittable_list.h"
 
 #include <algorithm>
 #include <memory>
 #include <random>
 
-bool box_x_compare(const std::shared_ptr<Hittable>& lhs, const std::shared_ptr<Hittable>& rhs)
+/*
+ *  BVH of separately allocated nodes, each holding its two children. The
+ *  build sorts and partitions a single array of the objects' boxes in
+ *  place, each node working on its own range of it.
+ */
+
+class BVHNode : public Hittable
 {
-	AABB boxLeft, boxRight;
-	if(!lhs->bounding_box(0.f, 0.f, boxLeft) || !rhs->bounding_box(0.f, 0.f, boxRight))
+public:
+	BVHNode() = default;
+	BVHNode(const hittables_vec& list, float time0, float time1, BVHSplit split = BVHSplit::Median)
 	{
-		std::cerr << "No bounding box in BVHNode constructor\n";
-	}
+		std::vector<BVHBuildPrimitive> prims;
+		prims.reserve(list.size());
+		for(size_t i = 0; i < list.size(); i++)
+		{
+			AABB b;
+			if(!list[i]->bounding_box(time0, time1, b))
+				std::cerr << "No bounding box in BVHNode constructor\n";
 
-	return boxLeft.min().x() < boxRight.min().x();
-}
+			prims.push_back({b, b.centroid(), static_cast<int>(i)});
+		}
 
-bool box_y_compare(const std::shared_ptr<Hittable>& lhs, const std::shared_ptr<Hittable>& rhs)
-{
-	AABB boxLeft, boxRight;
-	if(!lhs->bounding_box(0.f, 0.f, boxLeft) || !rhs->bounding_box(0.f, 0.f, boxRight))
+		std::vector<uint64_t> codes;
+		if(split == BVHSplit::Morton)
+		{
+			std::vector<AABB> boxes(prims.size());
+			for(size_t i = 0; i < prims.size(); i++) boxes[i] = prims[i].box;
+
+			const std::vector<uint32_t> order = bvh_morton_order(boxes, codes);
+			std::vector<BVHBuildPrimitive> sorted(prims.size());
+			for(size_t i = 0; i < prims.size(); i++) sorted[i] = prims[order[i]];
+			prims.swap(sorted);
+		}
+
+		std::mt19937 mt_engine(std::random_device{}());
+		const int n = static_cast<int>(prims.size());
+		build(list, prims, codes, 0, n, time0, time1, split, mt_engine);
+	}
+
+	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
 	{
-		std::cerr << "No bounding box in BVHNode constructor\n";
+		if(!box.hit(r, t_min, t_max)) return false;
+
+		if(left == right) return left->hit(r, t_min, t_max, rec);
+
+		// the left child holds the objects with the smaller coordinates along the
+		// split axis, so visit whichever child the ray reaches first and only
+		// look for hits in the other one which are closer than what we found
+		const bool left_first = r.direction()[axis] >= 0.f;
+		const Hittable* first = left_first ? left.get() : right.get();
+		const Hittable* second = left_first ? right.get() : left.get();
+
+		bool hit_first = first->hit(r, t_min, t_max, rec);
+		bool hit_second = second->hit(r, t_min, hit_first ? rec.t : t_max, rec);
+
+		return hit_first || hit_second;
 	}
 
-	return boxLeft.min().y() < boxRight.min().y();
-}
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		if(!box.hit(r, t_min, t_max)) return false;
 
-bool box_z_compare(const std::shared_ptr<Hittable>& lhs, const std::shared_ptr<Hittable>& rhs)
-{
-	AABB boxLeft, boxRight;
-	if(!lhs->bounding_box(0.f, 0.f, boxLeft) || !rhs->bounding_box(0.f, 0.f, boxRight))
+		return left->occluded(r, t_min, t_max) ||
+			   (left != right && right->occluded(r, t_min, t_max));
+	}
+
+	virtual bool bounding_box(float t0, float t1, AABB& b) const override
 	{
-		std::cerr << "No bounding box in BVHNode constructor\n";
+		b = box;
+		return true;
 	}
 
-	return boxLeft.min().z() < boxRight.min().z();
-}
+	// walks the tree and reports its shape and SAH cost
+	BVHStats stats() const
+	{
+		BVHStats s;
+		collect_stats(s, 1, box.surface_area());
+		return s;
+	}
 
-class BVHNode : public Hittable
-{
-public:
-	BVHNode() = default;
-	BVHNode(hittables_vec list, float time0, float time1)
+private:
+	BVHNode(const hittables_vec& list,
+			std::vector<BVHBuildPrimitive>& prims,
+			const std::vector<uint64_t>& codes,
+			int begin,
+			int end,
+			float time0,
+			float time1,
+			BVHSplit split,
+			std::mt19937& mt_engine)
 	{
-		std::mt19937 mt_engine(std::random_device{}());
-		std::uniform_real_distribution<float> fdist(0.f, 0.999f);
-		int axis = static_cast<int>(3.f * fdist(mt_engine));
+		build(list, prims, codes, begin, end, time0, time1, split, mt_engine);
+	}
 
-		if(axis == 0)
+	void build(const hittables_vec& list,
+			   std::vector<BVHBuildPrimitive>& prims,
+			   const std::vector<uint64_t>& codes,
+			   int begin,
+			   int end,
+			   float time0,
+			   float time1,
+			   BVHSplit split,
+			   std::mt19937& mt_engine)
+	{
+		const int n = end - begin;
+		if(n == 1)
 		{
-			std::sort(list.begin(), list.end(), box_x_compare);
+			left = list[prims[begin].index];
+			right = left;
 		}
-		else if(axis == 1)
+		else if(n == 2 && split == BVHSplit::SAH)
 		{
-			std::sort(list.begin(), list.end(), box_y_compare);
+			left = list[prims[begin].index];
+			right = list[prims[begin + 1].index];
 		}
 		else
 		{
-			std::sort(list.begin(), list.end(), box_z_compare);
-		}
+			int mid;
+			if(split == BVHSplit::SAH)
+			{
+				float cost;
+				mid = bvh_sah_split(prims, begin, end, axis, cost);
+			}
+			else if(split == BVHSplit::Morton)
+			{
+				mid = bvh_morton_split(codes, begin, end, axis);
+			}
+			else
+			{
+				// a random axis, sorting the objects by the low side of their boxes
+				std::uniform_int_distribution<int> axis_dist(0, 2);
+				axis = axis_dist(mt_engine);
+				std::sort(prims.begin() + begin,
+						  prims.begin() + end,
+						  [this](const BVHBuildPrimitive& a, const BVHBuildPrimitive& b) {
+							  return a.box.min()[axis] < b.box.min()[axis];
+						  });
+				mid = begin + n / 2;
+			}
 
-		const auto n = static_cast<int>(list.size());
-		if(list.size() == 1)
-		{
-			left = list[0];
-			right = list[0];
-		}
-		else if(list.size() == 2)
-		{
-			left = list[0];
-			right = list[1];
+			if(mid - begin == 1 && end - mid == 1)
+			{
+				left = list[prims[begin].index];
+				right = list[prims[mid].index];
+			}
+			else
+			{
+				left = std::shared_ptr<BVHNode>(
+					new BVHNode(list, prims, codes, begin, mid, time0, time1, split, mt_engine));
+				right = std::shared_ptr<BVHNode>(
+					new BVHNode(list, prims, codes, mid, end, time0, time1, split, mt_engine));
+			}
 		}
-		else
-		{
-			auto first = list.begin();
-			auto last = list.end();
-
-			std::vector<std::shared_ptr<Hittable>> leftHitables(first, first + n / 2);
-			left = std::make_shared<BVHNode>(leftHitables, time0, time1);
 
-			std::vector<std::shared_ptr<Hittable>> rightHitables(first + n / 2, last);
-			right = std::make_shared<BVHNode>(rightHitables, time0, time1);
-		}
+		compute_box(time0, time1);
+	}
 
+	void compute_box(float time0, float time1)
+	{
 		AABB box_left, box_right;
 		if(!left->bounding_box(time0, time1, box_left) ||
 		   !right->bounding_box(time0, time1, box_right))
 		{
 			std::cerr << "No bounding box in BVHNode ctor!\n";
-			box = AABB::surrounding_box(box_left, box_right);
 		}
+
+		box = AABB::surrounding_box(box_left, box_right);
 	}
 
-	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
+	void collect_stats(BVHStats& s, int depth, float root_area) const
 	{
-		if(box.hit(r, t_min, t_max))
-		{
-			HitRecord left_rec, right_rec;
-			bool hit_left = left->hit(r, t_min, t_max, left_rec);
-			bool hit_right = right->hit(r, t_min, t_max, right_rec);
-
-			if(hit_left && hit_right)
-			{
-				if(left_rec.t < right_rec.t)
-					rec = left_rec;
-				else
-					rec = right_rec;
+		const float area_ratio = root_area > 0.f ? box.surface_area() / root_area : 1.f;
+		auto left_node = dynamic_cast<const BVHNode*>(left.get());
+		auto right_node = dynamic_cast<const BVHNode*>(right.get());
 
-				return true;
-			}
-			else if(hit_left)
-			{
-				rec = left_rec;
-				return true;
-			}
-			else if(hit_right)
-			{
-				rec = right_rec;
-				return true;
-			}
-			else
-				return false;
+		// nodes either hold two subtrees or one or two primitives
+		if(left_node && right_node)
+		{
+			s.add_interior(area_ratio);
+			left_node->collect_stats(s, depth + 1, root_area);
+			right_node->collect_stats(s, depth + 1, root_area);
+		}
+		else
+		{
+			s.add_leaf(area_ratio, left == right ? 1 : 2, depth);
 		}
-
-		return false;
-	}
-
-	virtual bool bounding_box(float t0, float t1, AABB& b) const override
-	{
-		b = box;
-		return true;
 	}
 
 private:
 	std::shared_ptr<Hittable> left, right;
 	AABB box;
+	int axis = 0; // axis the objects were split along
 };
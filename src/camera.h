@@ -1,17 +1,47 @@
 #pragma once
 
 #include <cmath>
-#include <random>
 
 #include "ray.h"
+#include "sampler.h"
 
 #ifdef _WIN32
 constexpr double M_PI = 3.14159265358979323846;
 #endif
 
+/*
+ *  Where a camera is and what it sees, apart from the aspect ratio, which
+ *  comes from the image being rendered. Scenes carry one of these as their
+ *  default view.
+ */
+
+struct CameraSettings
+{
+	vec3 lookfrom;
+	vec3 lookat;
+	vec3 vup = vec3(0.f, 1.f, 0.f);
+	float vfov = 40.f;
+	float aperture = 0.f;
+	float focus_dist = 10.f;
+	float time0 = 0.f;
+	float time1 = 1.f;
+};
+
 class Camera
 {
 public:
+	Camera(const CameraSettings& s, float aspect)
+		: Camera(s.lookfrom,
+				 s.lookat,
+				 s.vup,
+				 s.vfov,
+				 aspect,
+				 s.aperture,
+				 s.focus_dist,
+				 s.time0,
+				 s.time1)
+	{}
+
 	Camera(vec3 lookfrom,
 		   vec3 lookat,
 		   vec3 vup,
@@ -38,14 +68,11 @@ public:
 		vertical = 2.f * half_height * focus_dist * v;
 	}
 
-	Ray get_ray(float s, float t)
+	Ray get_ray(float s, float t, Sampler& sampler) const
 	{
-		std::mt19937 mt_engine(std::random_device{}());
-		std::uniform_real_distribution<float> fdist(0.f, 0.999f);
-
-		vec3 rd = lens_radius * random_in_unit_disc();
+		vec3 rd = lens_radius * random_in_unit_disc(sampler);
 		vec3 offset = u * rd.x() + v * rd.y();
-		float time = time0 + fdist(mt_engine) * (time1 - time0);
+		float time = time0 + sampler.next_float() * (time1 - time0);
 
 		return Ray(origin + offset,
 				   lower_left_corner + s * horizontal + t * vertical - origin - offset,
@@ -53,18 +80,28 @@ public:
 	}
 
 private:
-	vec3 random_in_unit_disc()
+	// Shirley and Chiu's concentric mapping of the square onto the disc, which
+	// keeps evenly spread samples evenly spread, unlike rejection sampling
+	vec3 random_in_unit_disc(Sampler& sampler) const
 	{
-		vec3 p;
-		std::mt19937 mt_engine(std::random_device{}());
-		std::uniform_real_distribution<float> fdist(0.f, 0.999f);
+		const float a = 2.f * sampler.next_float() - 1.f;
+		const float b = 2.f * sampler.next_float() - 1.f;
+		if(a == 0.f && b == 0.f) return vec3(0.f, 0.f, 0.f);
 
-		do
+		constexpr float quarter_pi = static_cast<float>(M_PI) / 4.f;
+		float r, phi;
+		if(a * a > b * b)
+		{
+			r = a;
+			phi = quarter_pi * (b / a);
+		}
+		else
 		{
-			p = 2.f * vec3(fdist(mt_engine), fdist(mt_engine), 0.f) - vec3(1.f, 1.f, 0.f);
-		} while(dot(p, p) >= 1.f);
+			r = b;
+			phi = 2.f * quarter_pi - quarter_pi * (a / b);
+		}
 
-		return p;
+		return vec3(r * cos(phi), r * sin(phi), 0.f);
 	}
 
 private:
@@ -22,11 +22,28 @@ public:
 			return false;
 	}
 
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		return ptr->occluded(r, t_min, t_max);
+	}
+
 	virtual bool bounding_box(float t0, float t1, AABB& box) const override
 	{
 		return ptr->bounding_box(t0, t1, box);
 	}
 
+	virtual float pdf_value(const vec3& origin, const vec3& direction) const override
+	{
+		return ptr->pdf_value(origin, direction);
+	}
+
+	virtual vec3 random(const vec3& origin, Sampler& sampler) const override
+	{
+		return ptr->random(origin, sampler);
+	}
+
+	const std::shared_ptr<Hittable>& object() const { return ptr; }
+
 private:
 	std::shared_ptr<Hittable> ptr;
 };
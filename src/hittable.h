@@ -2,23 +2,65 @@
 
 #include "aabb.h"
 #include "ray.h"
+#include "sampler.h"
 
-#include <memory>
+#include <cstdint>
 
-class Material;
+class Hittable;
+
+// index of a material in the scene's MaterialRegistry
+using MaterialId = uint32_t;
+
+/*
+ *  Hits are filled in two steps. While the scene is traversed a primitive
+ *  only records the distance, the normal (which transforms fix up on the
+ *  way out) and where it was hit in its own coordinates. Once the closest
+ *  hit is known resolve() works out the point, texture coordinates and
+ *  material, so that work isn't repeated for hits that get replaced.
+ */
 
 struct HitRecord
 {
 	float t;
-	vec3 p;
 	vec3 normal;
+	vec3 local; // hit point in the primitive's coordinates
+	const Hittable* object;
+	uint32_t primitive; // part of the object that was hit, e.g. a mesh triangle
+
+	// only valid after resolve()
+	vec3 p;
 	float u, v;
-	std::shared_ptr<Material> mat_ptr;
+	MaterialId material;
+
+	inline void resolve(const Ray& r);
 };
 
 class Hittable
 {
 public:
+	// rec is only written to when a hit closer than t_max is found
 	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const = 0;
 	virtual bool bounding_box(float t0, float t1, AABB& box) const = 0;
+
+	// fills in the texture coordinates and material of a hit on this primitive
+	virtual void surface(HitRecord& rec) const {}
+
+	// true if anything is hit between t_min and t_max; used for shadow rays, so
+	// it can stop at the first hit and skip filling in a HitRecord
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const
+	{
+		HitRecord rec;
+		return hit(r, t_min, t_max, rec);
+	}
+
+	// shapes which can be used as lights sample directions towards themselves
+	// from origin; pdf_value is the solid angle density of sampling direction
+	virtual float pdf_value(const vec3& origin, const vec3& direction) const { return 0.f; }
+	virtual vec3 random(const vec3& origin, Sampler& sampler) const { return vec3(1.f, 0.f, 0.f); }
 };
+
+void HitRecord::resolve(const Ray& r)
+{
+	p = r.point_at_parameter(t);
+	object->surface(*this);
+}
@@ -2,6 +2,7 @@
 
 #include "hittable.h"
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -18,46 +19,62 @@ public:
 
 	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const
 	{
-		HitRecord temp_rec;
+		// rec is only written on a closer hit, so it can be passed straight down
 		bool hit_anything = false;
 		float closest_so_far = t_max;
 		for(int i = 0; i < list_size; i++)
 		{
-			if(list[i]->hit(r, t_min, closest_so_far, temp_rec))
+			if(list[i]->hit(r, t_min, closest_so_far, rec))
 			{
 				hit_anything = true;
-				closest_so_far = temp_rec.t;
-				rec = temp_rec;
+				closest_so_far = rec.t;
 			}
 		}
 
 		return hit_anything;
 	}
 
-	virtual bool bounding_box(float t0, float t1, AABB& box) const override
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
 	{
-		if(list.size() < 1) return false;
+		for(int i = 0; i < list_size; i++)
+		{
+			if(list[i]->occluded(r, t_min, t_max)) return true;
+		}
+
+		return false;
+	}
 
-		AABB temp_box;
-		bool first_true = list[0]->bounding_box(t0, t1, temp_box);
-		if(!first_true)
-			return false;
-		else
-			box = temp_box;
+	virtual bool bounding_box(float t0, float t1, AABB& box) const override
+	{
+		if(list_size < 1) return false;
 
-		for(size_t i = 1; i < list.size(); i++)
+		box = AABB::empty();
+		for(int i = 0; i < list_size; i++)
 		{
-			if(list[0]->bounding_box(t0, t1, temp_box))
-			{
-				box = AABB::surrounding_box(box, temp_box);
-			}
-			else
-				return false;
+			AABB temp_box;
+			if(!list[i]->bounding_box(t0, t1, temp_box)) return false;
+
+			box.grow(temp_box);
 		}
 
 		return true;
 	}
 
+	// picks one of the objects uniformly, so the density is the average of theirs
+	virtual float pdf_value(const vec3& origin, const vec3& direction) const override
+	{
+		float sum = 0.f;
+		for(int i = 0; i < list_size; i++) sum += list[i]->pdf_value(origin, direction);
+
+		return list_size > 0 ? sum / float(list_size) : 0.f;
+	}
+
+	virtual vec3 random(const vec3& origin, Sampler& sampler) const override
+	{
+		int i = std::min(static_cast<int>(sampler.next_float() * list_size), list_size - 1);
+		return list[i]->random(origin, sampler);
+	}
+
 private:
 	hittables_vec list;
 	int list_size;
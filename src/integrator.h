@@ -0,0 +1,162 @@
+#pragma once
+
+#include "hittable.h"
+#include "material.h"
+#include "sampler.h"
+#include "scene.h"
+#include "vec3.h"
+
+#include <limits>
+
+/*
+ *  Iterative path tracer. Instead of recursing once per bounce and building
+ *  the colour on the way back up, it carries the product of the attenuations
+ *  seen so far (the throughput) down the path and adds emitted light as it
+ *  is found. After a few bounces paths are terminated with Russian roulette:
+ *  a path survives with a probability based on its throughput and survivors
+ *  are scaled up by the inverse of that probability, so the image is not
+ *  biased but little time is spent on paths that barely contribute.
+ *
+ *  At every non-specular hit the scene's lights are also sampled directly
+ *  with a shadow ray (next event estimation). Light reached both ways is
+ *  weighted with the power heuristic (multiple importance sampling), so
+ *  small lights are found by the light samples and large or glossy
+ *  reflections of them by the BRDF samples without counting anything twice.
+ *
+ *  Each bounce draws from its own fixed block of sampler dimensions, after
+ *  the ones the camera used: the light sample, then the scattered direction,
+ *  then Russian roulette. Every sample of a pixel then uses the same
+ *  dimension for the same decision, which is what lets a low discrepancy
+ *  sequence spread them evenly.
+ */
+
+class PathTracer
+{
+public:
+	explicit PathTracer(int max_depth = 50, int roulette_depth = 3)
+		: _max_depth(max_depth)
+		, _roulette_depth(roulette_depth)
+	{}
+
+	vec3 colour(Ray r, const Scene& scene, Sampler& sampler) const
+	{
+		const Hittable& world = *scene.world;
+		const Hittable* lights = scene.lights.get();
+		const MaterialRegistry& materials = scene.materials;
+
+		vec3 radiance(0.f, 0.f, 0.f);
+		vec3 throughput(1.f, 1.f, 1.f);
+		bool specular_bounce = true; // light seen directly by the camera is never sampled
+		float scatter_pdf = 0.f;
+		vec3 scatter_origin;
+
+		for(int depth = 0;; depth++)
+		{
+			const uint32_t dimension = first_dimension + bounce_dimensions * depth;
+
+			HitRecord rec;
+			if(!world.hit(r, 0.001f, std::numeric_limits<float>::max(), rec)) break;
+			rec.resolve(r);
+
+			vec3 emitted = materials.emitted(rec);
+			if(specular_bounce || !lights)
+			{
+				radiance += throughput * emitted;
+			}
+			else
+			{
+				float light_pdf = lights->pdf_value(scatter_origin, r.direction());
+				radiance += throughput * emitted * power_heuristic(scatter_pdf, light_pdf);
+			}
+
+			if(depth >= _max_depth) break;
+
+			const bool specular = materials.is_specular(rec.material);
+			if(lights && !specular)
+			{
+				sampler.start_dimension(dimension + light_dimension);
+				radiance += throughput * sample_light(r, rec, scene, sampler);
+			}
+
+			Ray scattered;
+			vec3 attenuation;
+			sampler.start_dimension(dimension + scatter_dimension);
+			if(!materials.scatter(r, rec, attenuation, scattered, sampler)) break;
+
+			specular_bounce = specular;
+			if(!specular_bounce) scatter_pdf = materials.pdf(r, rec, scattered.direction());
+			scatter_origin = rec.p;
+			throughput *= attenuation;
+
+			if(depth >= _roulette_depth)
+			{
+				float survive = ffmin(max_component(throughput), 0.95f);
+				sampler.start_dimension(dimension + roulette_dimension);
+				if(sampler.next_float() >= survive) break;
+
+				throughput /= survive;
+			}
+
+			r = scattered;
+		}
+
+		return radiance;
+	}
+
+private:
+	// light arriving at rec from a point sampled on the lights, MIS weighted
+	vec3 sample_light(const Ray& r,
+					  const HitRecord& rec,
+					  const Scene& scene,
+					  Sampler& sampler) const
+	{
+		const vec3 none(0.f, 0.f, 0.f);
+		const Hittable& world = *scene.world;
+		const Hittable& lights = *scene.lights;
+		const MaterialRegistry& materials = scene.materials;
+
+		vec3 direction = lights.random(rec.p, sampler);
+		float light_pdf = lights.pdf_value(rec.p, direction);
+		if(light_pdf <= 0.f) return none;
+
+		vec3 f = materials.eval(r, rec, direction);
+		if(max_component(f) <= 0.f) return none;
+
+		// find where the sample lands on the lights, then only check that nothing
+		// in the world is in the way rather than searching it for the closest hit
+		HitRecord light_rec;
+		Ray shadow(rec.p, direction, r.time());
+		if(!lights.hit(shadow, 0.001f, std::numeric_limits<float>::max(), light_rec)) return none;
+		if(world.occluded(shadow, 0.001f, light_rec.t * (1.f - shadow_epsilon))) return none;
+		light_rec.resolve(shadow);
+
+		vec3 emitted = materials.emitted(light_rec);
+		float scatter_pdf = materials.pdf(r, rec, direction);
+
+		return f * emitted * (power_heuristic(light_pdf, scatter_pdf) / light_pdf);
+	}
+
+	static float power_heuristic(float pdf, float other_pdf)
+	{
+		float a = pdf * pdf;
+		float b = other_pdf * other_pdf;
+		return a > 0.f ? a / (a + b) : 0.f;
+	}
+
+	static float max_component(const vec3& v) { return ffmax(v.x(), ffmax(v.y(), v.z())); }
+
+private:
+	// shadow rays stop this fraction short of the light so they don't hit it
+	static constexpr float shadow_epsilon = 1e-3f;
+
+	// the pixel position, lens and time come first; in each bounce's block the
+	// light sample takes three dimensions, scattering up to three and roulette one
+	static constexpr uint32_t first_dimension = 8;
+	static constexpr uint32_t bounce_dimensions = 8;
+	static constexpr uint32_t light_dimension = 0;
+	static constexpr uint32_t scatter_dimension = 4;
+	static constexpr uint32_t roulette_dimension = 7;
+
+	int _max_depth;
+	int _roulette_depth;
+};
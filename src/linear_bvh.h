@@ -0,0 +1,612 @@
+#pragma once
+
+#include "aabb.h"
+#include "bvh_build.h"
+#include "hittable_list.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*
+ *  BVH stored as a flat array of 32 byte nodes in depth-first order: the
+ *  first child of an interior node is always the next node in the array, so
+ *  only the offset of the second child is stored. Leaves store a range into
+ *  an array of primitive indices. Traversal is an iterative loop with a
+ *  small stack and never touches a shared_ptr or a virtual function, the
+ *  caller decides how to intersect the primitives in a leaf.
+ *
+ *  Nothing in the arrays is a pointer, so they can also be used where they
+ *  lie in memory owned by something else, such as a mapped cache file.
+ *
+ *  The build partitions one array of primitives in place, so each subtree's
+ *  primitives end up in a contiguous range of it, which its leaves point
+ *  into. Large builds are spread over threads: the top levels are split one
+ *  node at a time with the binning of each node shared between threads,
+ *  then the subtrees below are built as separate tasks and spliced into
+ *  place. The tree is the same however many threads build it.
+ *
+ *  A Morton split sorts the array along a Morton curve instead and builds
+ *  each node's bounds from its children's, for builds fast enough to redo
+ *  every frame.
+ */
+
+struct alignas(32) LinearBVHNode
+{
+	AABB bounds;
+	union
+	{
+		uint32_t primitives_offset; // leaf
+		uint32_t second_child_offset; // interior
+	};
+	uint16_t num_primitives; // 0 for interior nodes
+	uint8_t axis; // split axis of interior nodes
+	uint8_t pad;
+};
+
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode should fill half a cache line");
+
+class LinearBVH
+{
+public:
+	static constexpr int max_depth = 64;
+
+	// primitives below which a build, or a subtree of one, uses one thread
+	static constexpr int min_task_size = 4096;
+
+	LinearBVH() = default;
+
+	// num_threads 0 uses every core
+	explicit LinearBVH(const std::vector<AABB>& boxes,
+					   BVHSplit split = BVHSplit::SAH,
+					   int max_leaf_size = 4,
+					   unsigned num_threads = 0)
+		: _split(split)
+		, _max_leaf_size(max_leaf_size)
+	{
+		if(boxes.empty()) return;
+
+		if(split == BVHSplit::Morton)
+		{
+			// quick enough that threads aren't worth it
+			std::vector<uint64_t> codes;
+			indices = bvh_morton_order(boxes, codes);
+			nodes.reserve(2 * boxes.size());
+			build_morton(boxes, codes, 0, static_cast<int>(boxes.size()), 1);
+			return;
+		}
+
+		std::vector<BVHBuildPrimitive> prims(boxes.size());
+		for(size_t i = 0; i < boxes.size(); i++)
+			prims[i] = {boxes[i], boxes[i].centroid(), static_cast<int>(i)};
+
+		const int n = static_cast<int>(prims.size());
+		num_threads = default_num_threads(num_threads);
+		nodes.reserve(2 * boxes.size());
+		if(num_threads == 1 || n < 2 * min_task_size)
+			build(prims, 0, n, 1, nodes);
+		else
+			build_parallel(prims, num_threads);
+
+		indices.resize(prims.size());
+		for(size_t i = 0; i < prims.size(); i++) indices[i] = static_cast<uint32_t>(prims[i].index);
+	}
+
+	// a BVH over arrays storage keeps alive, which must stay unchanged
+	LinearBVH(std::shared_ptr<const void> storage,
+			  const LinearBVHNode* nodes,
+			  size_t num_nodes,
+			  const uint32_t* indices,
+			  size_t num_indices)
+		: storage(std::move(storage))
+		, external_nodes(nodes)
+		, external_indices(indices)
+		, num_external_nodes(num_nodes)
+		, num_external_indices(num_indices)
+	{}
+
+	bool empty() const { return num_nodes() == 0; }
+	AABB bounds() const { return empty() ? AABB::empty() : node_array()[0].bounds; }
+
+	const LinearBVHNode* node_array() const { return storage ? external_nodes : nodes.data(); }
+	size_t num_nodes() const { return storage ? num_external_nodes : nodes.size(); }
+	const uint32_t* primitive_indices() const
+	{
+		return storage ? external_indices : indices.data();
+	}
+	size_t num_primitive_indices() const
+	{
+		return storage ? num_external_indices : indices.size();
+	}
+
+	/*
+	 *  Calls intersect(primitive_index, t_max) for every primitive in every
+	 *  leaf the ray reaches, nearest subtree first. intersect returns true on a
+	 *  hit and shrinks t_max to the distance of that hit, which culls
+	 *  everything further away.
+	 */
+	template <typename Intersect>
+	bool traverse(const Ray& r, float t_min, float t_max, Intersect&& intersect) const
+	{
+		if(empty()) return false;
+
+		const LinearBVHNode* const all_nodes = node_array();
+		const uint32_t* const leaf_indices = primitive_indices();
+
+		uint32_t stack[max_depth];
+		int stack_size = 0;
+		uint32_t current = 0;
+		bool hit_anything = false;
+
+		while(true)
+		{
+			const LinearBVHNode& node = all_nodes[current];
+			if(node.bounds.hit(r, t_min, t_max))
+			{
+				if(node.num_primitives > 0)
+				{
+					const uint32_t end = node.primitives_offset + node.num_primitives;
+					for(uint32_t i = node.primitives_offset; i < end; i++)
+					{
+						if(intersect(leaf_indices[i], t_max)) hit_anything = true;
+					}
+				}
+				else
+				{
+					// visit the near child first so hits in it shrink t_max before the
+					// far child is tested; the first child is on the low side of the split
+					if(r.sign(node.axis))
+					{
+						stack[stack_size++] = current + 1;
+						current = node.second_child_offset;
+					}
+					else
+					{
+						stack[stack_size++] = node.second_child_offset;
+						current = current + 1;
+					}
+					continue;
+				}
+			}
+
+			if(stack_size == 0) break;
+			current = stack[--stack_size];
+		}
+
+		return hit_anything;
+	}
+
+	// stops at the first primitive for which test(primitive_index) is true
+	template <typename Test>
+	bool traverse_any(const Ray& r, float t_min, float t_max, Test&& test) const
+	{
+		if(empty()) return false;
+
+		const LinearBVHNode* const all_nodes = node_array();
+		const uint32_t* const leaf_indices = primitive_indices();
+
+		uint32_t stack[max_depth];
+		int stack_size = 0;
+		uint32_t current = 0;
+
+		while(true)
+		{
+			const LinearBVHNode& node = all_nodes[current];
+			if(node.bounds.hit(r, t_min, t_max))
+			{
+				if(node.num_primitives > 0)
+				{
+					const uint32_t end = node.primitives_offset + node.num_primitives;
+					for(uint32_t i = node.primitives_offset; i < end; i++)
+					{
+						if(test(leaf_indices[i])) return true;
+					}
+				}
+				else
+				{
+					stack[stack_size++] = node.second_child_offset;
+					current = current + 1;
+					continue;
+				}
+			}
+
+			if(stack_size == 0) break;
+			current = stack[--stack_size];
+		}
+
+		return false;
+	}
+
+	BVHStats stats() const
+	{
+		BVHStats s;
+		if(!empty()) collect_stats(s, 0, 1, node_array()[0].bounds.surface_area());
+		return s;
+	}
+
+private:
+	// decides whether prims[begin, end) become a leaf, or otherwise where
+	// and along which axis they are split; partitions them for a split
+	bool split_node(std::vector<BVHBuildPrimitive>& prims,
+					int begin,
+					int end,
+					int depth,
+					const AABB& bounds,
+					int& mid,
+					int& axis,
+					unsigned num_threads) const
+	{
+		const int n = end - begin;
+		mid = (begin + end) / 2;
+		axis = 0;
+		if(n == 1 || depth >= max_depth) return false;
+
+		if(_split == BVHSplit::SAH)
+		{
+			float cost;
+			mid = bvh_sah_split(prims, begin, end, axis, cost, num_threads);
+
+			const float area = bounds.surface_area();
+			const float split_cost =
+				bvh_traversal_cost + (area > 0.f ? cost / area : 0.f) * bvh_intersection_cost;
+			return !(n <= _max_leaf_size && n * bvh_intersection_cost <= split_cost);
+		}
+
+		if(n <= _max_leaf_size) return false;
+
+		const AABB centroid_bounds = bvh_centroid_bounds(prims, begin, end, num_threads);
+		const vec3 extent = centroid_bounds.max() - centroid_bounds.min();
+		axis = extent.x() > extent.y() ? 0 : 1;
+		if(extent.z() > extent[axis]) axis = 2;
+
+		auto centroid_less = [axis](const BVHBuildPrimitive& a, const BVHBuildPrimitive& b) {
+			return a.centroid[axis] < b.centroid[axis];
+		};
+		std::nth_element(
+			prims.begin() + begin, prims.begin() + mid, prims.begin() + end, centroid_less);
+		return true;
+	}
+
+	static AABB primitive_bounds(const std::vector<BVHBuildPrimitive>& prims,
+								 int begin,
+								 int end,
+								 unsigned num_threads)
+	{
+		return bvh_parallel_reduce(
+			begin,
+			end,
+			num_threads,
+			AABB::empty(),
+			[&](int b, int e, AABB& bounds) {
+				for(int i = b; i < e; i++) bounds.grow(prims[i].box);
+			},
+			[](AABB& bounds, const AABB& other) { bounds.grow(other); });
+	}
+
+	static LinearBVHNode leaf(const AABB& bounds, int begin, int end)
+	{
+		LinearBVHNode node{};
+		node.bounds = bounds;
+		node.primitives_offset = static_cast<uint32_t>(begin);
+		node.num_primitives = static_cast<uint16_t>(end - begin);
+		node.axis = 0;
+		return node;
+	}
+
+	// builds the subtree over prims[begin, end) at the end of out, depth first
+	uint32_t build(std::vector<BVHBuildPrimitive>& prims,
+				   int begin,
+				   int end,
+				   int depth,
+				   std::vector<LinearBVHNode>& out) const
+	{
+		const auto node_index = static_cast<uint32_t>(out.size());
+		const AABB bounds = primitive_bounds(prims, begin, end, 1);
+
+		int mid, axis;
+		if(!split_node(prims, begin, end, depth, bounds, mid, axis, 1))
+		{
+			out.push_back(leaf(bounds, begin, end));
+			return node_index;
+		}
+
+		out.emplace_back();
+		out[node_index].bounds = bounds;
+
+		// the first child is built straight after its parent
+		build(prims, begin, mid, depth + 1, out);
+		const uint32_t second_child = build(prims, mid, end, depth + 1, out);
+
+		out[node_index].second_child_offset = second_child;
+		out[node_index].num_primitives = 0;
+		out[node_index].axis = static_cast<uint8_t>(axis);
+
+		return node_index;
+	}
+
+	// builds the subtree over the boxes of indices[begin, end), which are in
+	// Morton order, at the end of nodes; only leaves look at the boxes
+	uint32_t build_morton(const std::vector<AABB>& boxes,
+						  const std::vector<uint64_t>& codes,
+						  int begin,
+						  int end,
+						  int depth)
+	{
+		const auto node_index = static_cast<uint32_t>(nodes.size());
+		if(end - begin <= _max_leaf_size || depth >= max_depth)
+		{
+			AABB bounds = AABB::empty();
+			for(int i = begin; i < end; i++) bounds.grow(boxes[indices[i]]);
+			nodes.push_back(leaf(bounds, begin, end));
+			return node_index;
+		}
+
+		int axis;
+		const int mid = bvh_morton_split(codes, begin, end, axis);
+		nodes.emplace_back();
+		build_morton(boxes, codes, begin, mid, depth + 1);
+		const uint32_t second_child = build_morton(boxes, codes, mid, end, depth + 1);
+
+		LinearBVHNode& node = nodes[node_index];
+		node.bounds =
+			AABB::surrounding_box(nodes[node_index + 1].bounds, nodes[second_child].bounds);
+		node.second_child_offset = second_child;
+		node.num_primitives = 0;
+		node.axis = static_cast<uint8_t>(axis);
+
+		return node_index;
+	}
+
+	/*
+	 *  Parallel build
+	 */
+
+	// a node of the top levels, either split here or left to a task
+	struct TopNode
+	{
+		LinearBVHNode node{};
+		int first = -1, second = -1; // children in the top levels
+		int task = -1;
+	};
+
+	struct Task
+	{
+		int begin, end, depth;
+		std::vector<LinearBVHNode> nodes; // with offsets relative to the subtree
+	};
+
+	void build_parallel(std::vector<BVHBuildPrimitive>& prims, unsigned num_threads)
+	{
+		const int n = static_cast<int>(prims.size());
+		const int task_size = std::max(min_task_size, n / static_cast<int>(8 * num_threads));
+
+		std::vector<TopNode> top;
+		std::vector<Task> tasks;
+		build_top(prims, 0, n, 1, task_size, num_threads, top, tasks);
+
+		// biggest subtrees first, so no thread is left with a big one at the end
+		std::vector<size_t> order(tasks.size());
+		for(size_t i = 0; i < order.size(); i++) order[i] = i;
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return tasks[a].end - tasks[a].begin > tasks[b].end - tasks[b].begin;
+		});
+
+		std::atomic<size_t> next{0};
+		parallel_for(std::min<size_t>(num_threads, tasks.size()), [&](size_t) {
+			for(size_t i = next++; i < order.size(); i = next++)
+			{
+				Task& task = tasks[order[i]];
+				task.nodes.reserve(2 * static_cast<size_t>(task.end - task.begin));
+				build(prims, task.begin, task.end, task.depth, task.nodes);
+			}
+		});
+
+		splice(top, tasks, 0);
+	}
+
+	int build_top(std::vector<BVHBuildPrimitive>& prims,
+				  int begin,
+				  int end,
+				  int depth,
+				  int task_size,
+				  unsigned num_threads,
+				  std::vector<TopNode>& top,
+				  std::vector<Task>& tasks) const
+	{
+		const int index = static_cast<int>(top.size());
+		top.emplace_back();
+		if(end - begin <= task_size)
+		{
+			top[index].task = static_cast<int>(tasks.size());
+			tasks.push_back({begin, end, depth, {}});
+			return index;
+		}
+
+		const AABB bounds = primitive_bounds(prims, begin, end, num_threads);
+		int mid, axis;
+		if(!split_node(prims, begin, end, depth, bounds, mid, axis, num_threads))
+		{
+			top[index].node = leaf(bounds, begin, end);
+			return index;
+		}
+
+		const int first =
+			build_top(prims, begin, mid, depth + 1, task_size, num_threads, top, tasks);
+		const int second =
+			build_top(prims, mid, end, depth + 1, task_size, num_threads, top, tasks);
+
+		TopNode& node = top[index];
+		node.node.bounds = bounds;
+		node.node.num_primitives = 0;
+		node.node.axis = static_cast<uint8_t>(axis);
+		node.first = first;
+		node.second = second;
+		return index;
+	}
+
+	// appends the top node and everything below it to nodes, depth first
+	uint32_t splice(const std::vector<TopNode>& top, const std::vector<Task>& tasks, int index)
+	{
+		const auto node_index = static_cast<uint32_t>(nodes.size());
+		const TopNode& t = top[index];
+		if(t.task >= 0)
+		{
+			for(LinearBVHNode node : tasks[t.task].nodes)
+			{
+				if(node.num_primitives == 0) node.second_child_offset += node_index;
+				nodes.push_back(node);
+			}
+			return node_index;
+		}
+
+		nodes.push_back(t.node);
+		if(t.first >= 0)
+		{
+			splice(top, tasks, t.first);
+			nodes[node_index].second_child_offset = splice(top, tasks, t.second);
+		}
+		return node_index;
+	}
+
+	void collect_stats(BVHStats& s, uint32_t index, int depth, float root_area) const
+	{
+		const LinearBVHNode& node = node_array()[index];
+		const float area_ratio = root_area > 0.f ? node.bounds.surface_area() / root_area : 1.f;
+		if(node.num_primitives > 0)
+		{
+			s.add_leaf(area_ratio, node.num_primitives, depth);
+		}
+		else
+		{
+			s.add_interior(area_ratio);
+			collect_stats(s, index + 1, depth + 1, root_area);
+			collect_stats(s, node.second_child_offset, depth + 1, root_area);
+		}
+	}
+
+private:
+	std::vector<LinearBVHNode> nodes;
+	std::vector<uint32_t> indices; // primitive indices referenced by the leaves
+	BVHSplit _split = BVHSplit::SAH;
+	int _max_leaf_size = 4;
+
+	// arrays owned by storage instead, if it is set
+	std::shared_ptr<const void> storage;
+	const LinearBVHNode* external_nodes = nullptr;
+	const uint32_t* external_indices = nullptr;
+	size_t num_external_nodes = 0;
+	size_t num_external_indices = 0;
+};
+
+/*
+ *  Supplies the BVHs of objects made from a list of boxes. Objects build
+ *  their own when given none; a BVHCache hands back ones built before.
+ */
+
+class BVHSource
+{
+public:
+	virtual ~BVHSource() = default;
+	virtual LinearBVH build(const std::vector<AABB>& boxes, BVHSplit split) = 0;
+};
+
+inline LinearBVH build_linear_bvh(const std::vector<AABB>& boxes,
+								  BVHSplit split,
+								  BVHSource* source)
+{
+	return source ? source->build(boxes, split) : LinearBVH(boxes, split);
+}
+
+/*
+ *  A list of hittables accelerated by a LinearBVH. The objects are kept
+ *  alive by the shared pointers, traversal only uses raw pointers. Objects
+ *  without a bounding box can't go in the BVH, so each ray tests them
+ *  after traversing it, and the list then has no bounding box either.
+ */
+
+class LinearBVHList : public Hittable
+{
+public:
+	LinearBVHList(const hittables_vec& l,
+				  float time0,
+				  float time1,
+				  BVHSplit split = BVHSplit::SAH,
+				  BVHSource* source = nullptr)
+		: list(l)
+	{
+		std::vector<AABB> boxes;
+		boxes.reserve(list.size());
+		raw.reserve(list.size());
+		for(const auto& h : list)
+		{
+			AABB b;
+			if(!h->bounding_box(time0, time1, b))
+			{
+				unbounded.push_back(h.get());
+				continue;
+			}
+
+			boxes.push_back(b);
+			raw.push_back(h.get());
+		}
+
+		bvh = build_linear_bvh(boxes, split, source);
+	}
+
+	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
+	{
+		float closest_so_far = t_max;
+		bool hit_anything =
+			bvh.traverse(r, t_min, t_max, [&](uint32_t i, float& closest_in_bvh) {
+				if(raw[i]->hit(r, t_min, closest_in_bvh, rec))
+				{
+					closest_in_bvh = rec.t;
+					return true;
+				}
+
+				return false;
+			});
+		if(hit_anything) closest_so_far = rec.t;
+
+		for(const Hittable* h : unbounded)
+		{
+			if(h->hit(r, t_min, closest_so_far, rec))
+			{
+				closest_so_far = rec.t;
+				hit_anything = true;
+			}
+		}
+
+		return hit_anything;
+	}
+
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		for(const Hittable* h : unbounded)
+			if(h->occluded(r, t_min, t_max)) return true;
+
+		return bvh.traverse_any(
+			r, t_min, t_max, [&](uint32_t i) { return raw[i]->occluded(r, t_min, t_max); });
+	}
+
+	virtual bool bounding_box(float t0, float t1, AABB& box) const override
+	{
+		if(bvh.empty() || !unbounded.empty()) return false;
+
+		box = bvh.bounds();
+		return true;
+	}
+
+	BVHStats stats() const { return bvh.stats(); }
+
+private:
+	hittables_vec list;
+	std::vector<const Hittable*> raw; // indexed by the BVH
+	std::vector<const Hittable*> unbounded;
+	LinearBVH bvh;
+};
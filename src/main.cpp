@@ -1,82 +1,107 @@
 #include <iostream>
 #include <memory>
-#include <random>
 #include <vector>
 
 #include "camera.h"
+#include "options.h"
+#include "renderer.h"
 #include "scene_factory.h"
+#include "scene_loader.h"
 #include "timer.h"
-#include "util.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
-int main()
+static void list_scenes(std::ostream& os)
 {
-	Timer t("Elapsed");
-
-	constexpr int width = 600;
-	constexpr int height = 300;
-	constexpr int num_samples = 100; // per pixel
-	constexpr int num_channels = 3;
-
-	const vec3 lower_left_corner(-2.f, -1.f, -1.f);
-	const vec3 horizontal(4.f, 0.f, 0.f);
-	const vec3 vertical(0.f, 2.f, 0.f);
-	const vec3 origin(0.f, 0.f, 0.f);
-
-	vec3 lookfrom(278.f, 278.f, -800.f);
-	vec3 lookat(278.f, 278.f, 0.f);
-	vec3 cam_up(0.f, 1.f, 0.f);
-	constexpr float dist_to_focus = 10.f;
-	constexpr float aperture = 0.0f;
-	constexpr float fov = 40.f;
-	constexpr float aspect_ratio = static_cast<float>(width) / static_cast<float>(height);
-	Camera cam(lookfrom, lookat, cam_up, fov, aspect_ratio, aperture, dist_to_focus, 0.f, 1.f);
+	os << "Scenes:";
+	for(const auto& scene : SceneFactory::scenes()) os << " " << scene.first;
+	os << "\n";
+}
 
-	std::mt19937 mt_engine(std::random_device{}());
-	std::uniform_real_distribution<float> fdist(0.f, 0.999f);
+static bool write_png(const std::string& filename,
+					  int width,
+					  int height,
+					  const std::vector<unsigned char>& image)
+{
+	if(stbi_write_png(filename.c_str(),
+					  width,
+					  height,
+					  Renderer::num_channels,
+					  &image[0],
+					  width * Renderer::num_channels))
+		return true;
+
+	std::cerr << "Could not write '" << filename << "'\n";
+	return false;
+}
 
-	std::cout << "Generating scene... ";
-	auto world = SceneFactory::cornell_box();
-	std::cout << "Done! \n";
+int main(int argc, char** argv)
+{
+	RenderOptions options;
+	bool help = false;
+	if(!options.parse(argc, argv, help))
+	{
+		std::cerr << "Try '" << argv[0] << " --help'\n";
+		return 1;
+	}
+	if(help)
+	{
+		RenderOptions::usage(std::cout, argv[0]);
+		list_scenes(std::cout);
+		return 0;
+	}
 
-	std::cout << "Generating image... ";
+	Timer t("Elapsed");
 
-	std::vector<unsigned char> image(width * height * num_channels);
-	for(int row = height - 1; row >= 0; row--)
+	// a built in scene, or else a scene file
+	Scene scene;
+	if(const SceneFactory::Builder build = SceneFactory::find(options.scene))
+	{
+		std::cout << "Generating scene " << options.scene << "... ";
+		scene = build();
+		std::cout << "Done! \n";
+	}
+	else
 	{
-		for(int column = 0; column < width; column++)
+		SceneLoader::Stats stats;
+		std::cout << "Loading scene " << options.scene << "...\n";
+		if(!SceneLoader::load(options.scene, scene, &stats, options.cache))
 		{
-			vec3 col(0.f, 0.f, 0.f);
-			for(int s = 0; s < num_samples; s++)
-			{
-				float u = (float(column) + fdist(mt_engine)) / float(width);
-				float v = (float(row) + fdist(mt_engine)) / float(height);
+			list_scenes(std::cerr);
+			return 1;
+		}
+		stats.print(std::cout);
+	}
 
-				Ray r = cam.get_ray(u, v);
-				vec3 p = r.point_at_parameter(2.f);
-				col += Util::colour(r, world, 0);
-			}
+	const float aspect_ratio = static_cast<float>(options.width) / options.height;
+	Camera cam(scene.camera, aspect_ratio);
 
-			col /= float(num_samples);
-			col = vec3(sqrt(col[0]), sqrt(col[1]), sqrt(col[2]));
+	Renderer renderer(options.width,
+					  options.height,
+					  options.samples,
+					  16,
+					  options.threads,
+					  options.seed,
+					  options.sequence);
+	if(options.max_samples > options.samples)
+		renderer.set_adaptive(options.max_samples, options.threshold);
 
-			int y = height - row - 1;
-            image[static_cast<size_t>((column + y * width) * num_channels + 0)] =
-				static_cast<unsigned char>(int(255.99f * col.r()));
-            image[static_cast<size_t>((column + y * width) * num_channels + 1)] =
-				static_cast<unsigned char>(int(255.99f * col.g()));
-            image[static_cast<size_t>((column + y * width) * num_channels + 2)] =
-				static_cast<unsigned char>(int(255.99f * col.b()));
-		}
-	}
+	std::cout << "Generating image on " << renderer.num_threads() << " threads... ";
+	std::vector<int> samples_used;
+	std::vector<unsigned char> image =
+		renderer.render(cam, scene, PathTracer(options.max_depth), &samples_used);
 
 	std::cout << "Done!\n";
 	std::cout << "Writing to file... ";
 
-	std::string filename = "out.png";
-	stbi_write_png(filename.c_str(), width, height, num_channels, &image[0], width * num_channels);
+	if(!write_png(options.output, options.width, options.height, image)) return 1;
+	if(!options.spp_output.empty() &&
+	   !write_png(options.spp_output,
+				  options.width,
+				  options.height,
+				  renderer.samples_image(samples_used)))
+		return 1;
 
 	std::cout << "Done!\n";
 }
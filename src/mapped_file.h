@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#include <fstream>
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ *  Read only view of a whole file. On POSIX systems the file is memory
+ *  mapped so large models are paged in as they are parsed rather than
+ *  copied into a buffer first; elsewhere it is simply read into memory.
+ */
+
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& path)
+	{
+#ifdef _WIN32
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if(!file) return;
+
+		buffer.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		if(!file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()))) return;
+
+		_data = buffer.data();
+		_size = buffer.size();
+		_open = true;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if(fd < 0) return;
+
+		struct stat st;
+		if(::fstat(fd, &st) == 0)
+		{
+			_size = static_cast<size_t>(st.st_size);
+			if(_size == 0)
+			{
+				_open = true;
+			}
+			else
+			{
+				void* p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if(p != MAP_FAILED)
+				{
+					::madvise(p, _size, MADV_SEQUENTIAL);
+					_data = static_cast<const char*>(p);
+					_open = true;
+				}
+				else
+				{
+					_size = 0;
+				}
+			}
+		}
+
+		::close(fd);
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifndef _WIN32
+		if(_data) ::munmap(const_cast<char*>(_data), _size);
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool is_open() const { return _open; }
+	const char* data() const { return _data; }
+	size_t size() const { return _size; }
+
+private:
+#ifdef _WIN32
+	std::vector<char> buffer;
+#endif
+	const char* _data = nullptr;
+	size_t _size = 0;
+	bool _open = false;
+};
@@ -1,53 +1,104 @@
 #pragma once
 
-#include <random>
-
 #include "hittable.h"
+#include "sampler.h"
 #include "texture.h"
 
-vec3 random_in_unit_sphere()
+#include <variant>
+
+vec3 random_unit_vector(Sampler& sampler)
 {
-	std::mt19937 mt_engine(std::random_device{}());
-	std::uniform_real_distribution<float> fdist(0.f, 0.999f);
-	vec3 p;
+	float z = 1.f - 2.f * sampler.next_float();
+	float phi = 2.f * static_cast<float>(M_PI) * sampler.next_float();
+	float r = sqrt(ffmax(0.f, 1.f - z * z));
 
-	do
-	{
-		p = 2.f * vec3(fdist(mt_engine), fdist(mt_engine), fdist(mt_engine)) - vec3(1.f, 1.f, 1.f);
-	} while(p.squared_length() >= 1.f);
+	return vec3(r * cos(phi), r * sin(phi), z);
+}
 
-	return p;
+// a direction and a distance rather than rejection sampling the cube, so it
+// always takes three sample dimensions; the cube root makes the density uniform
+vec3 random_in_unit_sphere(Sampler& sampler)
+{
+	vec3 direction = random_unit_vector(sampler);
+	return cbrt(sampler.next_float()) * direction;
 }
 
-class Material
+/*
+ *  Behaviour shared by the materials, which hide whichever of these they
+ *  implement. Nothing here is virtual: a Material is a variant of the
+ *  concrete types and MaterialRegistry switches on it, so every call is
+ *  direct and can be inlined.
+ *
+ *  Materials which aren't specular can be lit by sampling the lights
+ *  directly. For those eval returns the BRDF times the cosine term for
+ *  light arriving from direction, and pdf the density with which
+ *  scatter() would have picked that direction.
+ */
+
+class BaseMaterial
 {
 public:
-	virtual bool
-	scatter(const Ray& r_in, const HitRecord& rec, vec3& attenuation, Ray& scattered) const = 0;
-	virtual vec3 emitted(float u, float v, const vec3& p) const { return vec3(0.f, 0.f, 0.f); }
+	vec3 emitted(const TextureTable& textures, float u, float v, const vec3& p) const
+	{
+		return vec3(0.f, 0.f, 0.f);
+	}
+
+	bool is_specular() const { return true; }
+	vec3 eval(const TextureTable& textures,
+			  const Ray& r_in,
+			  const HitRecord& rec,
+			  const vec3& direction) const
+	{
+		return vec3(0.f, 0.f, 0.f);
+	}
+	float pdf(const Ray& r_in, const HitRecord& rec, const vec3& direction) const { return 0.f; }
 };
 
-class Lambertian : public Material
+class Lambertian : public BaseMaterial
 {
 public:
-	Lambertian(std::shared_ptr<Texture> a)
+	Lambertian(TextureId a)
 		: albedo(a)
 	{}
 
-	virtual bool
-	scatter(const Ray& r_in, const HitRecord& rec, vec3& attenuation, Ray& scattered) const override
+	bool scatter(const TextureTable& textures,
+				 const Ray& r_in,
+				 const HitRecord& rec,
+				 vec3& attenuation,
+				 Ray& scattered,
+				 Sampler& sampler) const
 	{
-		vec3 target = rec.p + rec.normal + random_in_unit_sphere();
-		scattered = Ray(rec.p, target - rec.p, r_in.time());
-		attenuation = albedo->value(rec.u, rec.v, rec.p);
+		// normal + a point on the unit sphere is distributed with the cosine,
+		// which cancels with the BRDF leaving just the albedo
+		vec3 direction = rec.normal + random_unit_vector(sampler);
+		if(direction.squared_length() < 1e-8f) direction = rec.normal;
+
+		scattered = Ray(rec.p, direction, r_in.time());
+		attenuation = textures.value(albedo, rec.u, rec.v, rec.p);
 		return true;
 	}
 
+	bool is_specular() const { return false; }
+
+	vec3 eval(const TextureTable& textures,
+			  const Ray& r_in,
+			  const HitRecord& rec,
+			  const vec3& direction) const
+	{
+		return textures.value(albedo, rec.u, rec.v, rec.p) * pdf(r_in, rec, direction);
+	}
+
+	float pdf(const Ray& r_in, const HitRecord& rec, const vec3& direction) const
+	{
+		float cosine = dot(rec.normal, direction) / direction.length();
+		return cosine > 0.f ? cosine / static_cast<float>(M_PI) : 0.f;
+	}
+
 private:
-	std::shared_ptr<Texture> albedo;
+	TextureId albedo;
 };
 
-class Metal : public Material
+class Metal : public BaseMaterial
 {
 public:
 	Metal(const vec3& a, float f)
@@ -59,11 +110,15 @@ public:
 			fuzz = 1.f;
 	}
 
-	virtual bool
-	scatter(const Ray& r_in, const HitRecord& rec, vec3& attenuation, Ray& scattered) const override
+	bool scatter(const TextureTable& textures,
+				 const Ray& r_in,
+				 const HitRecord& rec,
+				 vec3& attenuation,
+				 Ray& scattered,
+				 Sampler& sampler) const
 	{
 		vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-		scattered = Ray(rec.p, reflected + fuzz * random_in_unit_sphere());
+		scattered = Ray(rec.p, reflected + fuzz * random_in_unit_sphere(sampler));
 		attenuation = albedo;
 
 		return (dot(scattered.direction(), rec.normal) > 0);
@@ -74,15 +129,19 @@ private:
 	float fuzz;
 };
 
-class Dielectric : public Material
+class Dielectric : public BaseMaterial
 {
 public:
 	Dielectric(float ri)
 		: ref_idx(ri)
 	{}
 
-	virtual bool
-	scatter(const Ray& r_in, const HitRecord& rec, vec3& attenuation, Ray& scattered) const override
+	bool scatter(const TextureTable& textures,
+				 const Ray& r_in,
+				 const HitRecord& rec,
+				 vec3& attenuation,
+				 Ray& scattered,
+				 Sampler& sampler) const
 	{
 		vec3 outward_normal, refracted;
 		vec3 reflected = reflect(r_in.direction(), rec.normal);
@@ -112,10 +171,7 @@ public:
 			reflected_prob = 1.f;
 		}
 
-		std::mt19937 mt_engine(std::random_device{}());
-		std::uniform_real_distribution<float> fdist(0.f, 0.999f);
-
-		if(fdist(mt_engine) < reflected_prob)
+		if(sampler.next_float() < reflected_prob)
 		{
 			scattered = Ray(rec.p, reflected);
 		}
@@ -131,24 +187,46 @@ private:
 	float ref_idx;
 };
 
-class DiffuseLight : public Material
+class DiffuseLight : public BaseMaterial
 {
 public:
-	DiffuseLight(std::shared_ptr<Texture> a)
+	DiffuseLight(TextureId a)
 		: emit(a)
 	{}
 
-	virtual bool
-	scatter(const Ray& r_in, const HitRecord& rec, vec3& attenuation, Ray& scattered) const override
+	bool scatter(const TextureTable& textures,
+				 const Ray& r_in,
+				 const HitRecord& rec,
+				 vec3& attenuation,
+				 Ray& scattered,
+				 Sampler& sampler) const
 	{
 		return false;
 	}
 
-	virtual vec3 emitted(float u, float v, const vec3& p) const override
+	vec3 emitted(const TextureTable& textures, float u, float v, const vec3& p) const
 	{
-		return emit->value(u, v, p);
+		return textures.value(emit, u, v, p);
 	}
 
 private:
-	std::shared_ptr<Texture> emit;
+	TextureId emit;
 };
+
+using Material = std::variant<Lambertian, Metal, Dielectric, DiffuseLight>;
+
+// calls f with the concrete material; a plain switch rather than std::visit,
+// which some standard libraries implement with a table of function pointers
+template <typename F>
+decltype(auto) visit_material(const Material& mat, F&& f)
+{
+	static_assert(std::variant_size_v<Material> == 4, "visit_material needs a case per material");
+
+	switch(mat.index())
+	{
+	case 0: return f(*std::get_if<0>(&mat));
+	case 1: return f(*std::get_if<1>(&mat));
+	case 2: return f(*std::get_if<2>(&mat));
+	default: return f(*std::get_if<3>(&mat));
+	}
+}
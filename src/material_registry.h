@@ -0,0 +1,82 @@
+#pragma once
+
+#include "hittable.h"
+#include "material.h"
+#include "texture.h"
+
+#include <utility>
+#include <variant>
+#include <vector>
+
+/*
+ *  Owns the materials and textures of a scene. Primitives and hit records
+ *  refer to a material by its index in here, so recording a hit is a plain
+ *  integer copy rather than a reference count shared by every thread.
+ *
+ *  Shading goes through here too: the material for a hit is looked up and
+ *  visit_material() switches on it, so the concrete material's code is
+ *  inlined at each call site.
+ */
+
+class MaterialRegistry
+{
+public:
+	MaterialId add(Material mat)
+	{
+		materials.push_back(std::move(mat));
+		return static_cast<MaterialId>(materials.size() - 1);
+	}
+
+	template <typename T, typename... Args>
+	MaterialId emplace(Args&&... args)
+	{
+		return add(T(std::forward<Args>(args)...));
+	}
+
+	TextureId add_texture(Texture texture) { return _textures.add(std::move(texture)); }
+
+	const Material& operator[](MaterialId id) const { return materials[id]; }
+	const TextureTable& textures() const { return _textures; }
+	size_t size() const { return materials.size(); }
+
+	bool scatter(const Ray& r_in,
+				 const HitRecord& rec,
+				 vec3& attenuation,
+				 Ray& scattered,
+				 Sampler& sampler) const
+	{
+		return visit_material(materials[rec.material], [&](const auto& mat) {
+			return mat.scatter(_textures, r_in, rec, attenuation, scattered, sampler);
+		});
+	}
+
+	vec3 emitted(const HitRecord& rec) const
+	{
+		return visit_material(materials[rec.material], [&](const auto& mat) {
+			return mat.emitted(_textures, rec.u, rec.v, rec.p);
+		});
+	}
+
+	bool is_specular(MaterialId id) const
+	{
+		return visit_material(materials[id], [](const auto& mat) { return mat.is_specular(); });
+	}
+
+	vec3 eval(const Ray& r_in, const HitRecord& rec, const vec3& direction) const
+	{
+		return visit_material(materials[rec.material], [&](const auto& mat) {
+			return mat.eval(_textures, r_in, rec, direction);
+		});
+	}
+
+	float pdf(const Ray& r_in, const HitRecord& rec, const vec3& direction) const
+	{
+		return visit_material(materials[rec.material], [&](const auto& mat) {
+			return mat.pdf(r_in, rec, direction);
+		});
+	}
+
+private:
+	std::vector<Material> materials;
+	TextureTable _textures;
+};
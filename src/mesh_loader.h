@@ -0,0 +1,768 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "parallel.h"
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ *  Loads triangle meshes from PLY (ascii or binary) and OBJ files. Both read
+ *  straight from a memory mapped file. Binary PLY is read in one pass with
+ *  no text parsing; OBJ is split into chunks at line boundaries that are
+ *  parsed in parallel, then stitched together. Polygons are triangulated
+ *  as fans. On failure the loaders print why and return null.
+ */
+
+class MeshLoader
+{
+public:
+	// picks the loader from the file extension
+	static std::shared_ptr<MeshData> load(const std::string& path, int num_threads = 0)
+	{
+		const std::string ext = extension(path);
+		if(ext == "ply") return load_ply(path);
+		if(ext == "obj") return load_obj(path, num_threads);
+
+		std::cerr << "Unknown mesh format: " << path << "\n";
+		return nullptr;
+	}
+
+	static std::shared_ptr<MeshData> load_ply(const std::string& path)
+	{
+		MappedFile file(path);
+		if(!file.is_open())
+		{
+			std::cerr << "Could not open " << path << "\n";
+			return nullptr;
+		}
+
+		PlyHeader header;
+		std::string error;
+		if(!parse_ply_header(file.data(), file.size(), header, error))
+		{
+			std::cerr << path << ": " << error << "\n";
+			return nullptr;
+		}
+
+		auto mesh = std::make_shared<MeshData>();
+		const char* body = file.data() + header.body_offset;
+		PlyReader reader(body, file.data() + file.size(), header.format);
+		for(const PlyElement& element : header.elements)
+		{
+			if(element.name == "vertex")
+				read_ply_vertices(reader, element, *mesh);
+			else if(element.name == "face")
+				read_ply_faces(reader, element, *mesh);
+			else
+				skip_ply_element(reader, element);
+
+			if(!reader.ok)
+			{
+				std::cerr << path << ": unexpected end of data in " << element.name << "\n";
+				return nullptr;
+			}
+		}
+
+		const uint32_t num_vertices = static_cast<uint32_t>(mesh->num_vertices());
+		for(uint32_t i : mesh->indices)
+		{
+			if(i >= num_vertices)
+			{
+				std::cerr << path << ": face refers to vertex " << i << " of " << num_vertices
+						  << "\n";
+				return nullptr;
+			}
+		}
+
+		if(mesh->num_triangles() == 0)
+		{
+			std::cerr << path << ": no triangles\n";
+			return nullptr;
+		}
+
+		return mesh;
+	}
+
+	static std::shared_ptr<MeshData> load_obj(const std::string& path, int num_threads = 0)
+	{
+		MappedFile file(path);
+		if(!file.is_open())
+		{
+			std::cerr << "Could not open " << path << "\n";
+			return nullptr;
+		}
+
+		// chunks of at least a megabyte, each starting at the beginning of a line
+		constexpr size_t min_chunk_size = 1 << 20;
+		if(num_threads <= 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+		const size_t num_chunks =
+			std::min(static_cast<size_t>(num_threads), file.size() / min_chunk_size + 1);
+
+		const char* const begin = file.data();
+		const char* const end = file.data() + file.size();
+		std::vector<ObjChunk> chunks(num_chunks);
+		for(size_t i = 0; i < num_chunks; i++)
+		{
+			chunks[i].begin = i == 0 ? begin : chunks[i - 1].end;
+			chunks[i].end = i + 1 == num_chunks
+								? end
+								: next_line(begin + file.size() * (i + 1) / num_chunks, end);
+			chunks[i].end = std::max(chunks[i].end, chunks[i].begin);
+		}
+
+		parallel_for(num_chunks, [&](size_t i) { parse_obj_chunk(chunks[i]); });
+
+		// where each chunk's vertices and triangles go in the combined mesh
+		ObjCounts total;
+		bool all_normals = true, all_uvs = true;
+		for(ObjChunk& chunk : chunks)
+		{
+			if(chunk.error)
+			{
+				std::cerr << path << ": could not be parsed\n";
+				return nullptr;
+			}
+
+			chunk.offsets = total;
+			total.positions += chunk.px.size();
+			total.normals += chunk.nx.size();
+			total.uvs += chunk.tu.size();
+			total.triangles += chunk.corners.size() / 9;
+			all_normals &= chunk.all_normals;
+			all_uvs &= chunk.all_uvs;
+		}
+
+		const bool use_normals = total.normals > 0 && all_normals;
+		const bool use_uvs = total.uvs > 0 && all_uvs;
+
+		auto mesh = std::make_shared<MeshData>();
+		mesh->px.resize(total.positions);
+		mesh->py.resize(total.positions);
+		mesh->pz.resize(total.positions);
+		mesh->indices.resize(3 * total.triangles);
+		if(use_normals)
+		{
+			mesh->nx.resize(total.normals);
+			mesh->ny.resize(total.normals);
+			mesh->nz.resize(total.normals);
+			mesh->normal_indices.resize(3 * total.triangles);
+		}
+		if(use_uvs)
+		{
+			mesh->tu.resize(total.uvs);
+			mesh->tv.resize(total.uvs);
+			mesh->uv_indices.resize(3 * total.triangles);
+		}
+
+		parallel_for(num_chunks, [&](size_t i) {
+			copy_obj_chunk(chunks[i], total, use_normals, use_uvs, *mesh);
+		});
+
+		for(const ObjChunk& chunk : chunks)
+		{
+			if(chunk.error)
+			{
+				std::cerr << path << ": face refers to a vertex that doesn't exist\n";
+				return nullptr;
+			}
+		}
+
+		if(mesh->num_triangles() == 0)
+		{
+			std::cerr << path << ": no triangles\n";
+			return nullptr;
+		}
+
+		return mesh;
+	}
+
+private:
+	static std::string extension(const std::string& path)
+	{
+		const size_t dot = path.find_last_of('.');
+		if(dot == std::string::npos) return "";
+
+		std::string ext = path.substr(dot + 1);
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) {
+			return static_cast<char>(std::tolower(c));
+		});
+		return ext;
+	}
+
+	static const char* next_line(const char* p, const char* end)
+	{
+		const void* newline = std::memchr(p, '\n', static_cast<size_t>(end - p));
+		return newline ? static_cast<const char*>(newline) + 1 : end;
+	}
+
+	/*
+	 *  PLY
+	 */
+
+	enum class PlyType
+	{
+		Int8,
+		UInt8,
+		Int16,
+		UInt16,
+		Int32,
+		UInt32,
+		Float32,
+		Float64,
+		Invalid
+	};
+
+	enum class PlyFormat
+	{
+		Ascii,
+		BinaryLittleEndian,
+		BinaryBigEndian
+	};
+
+	struct PlyProperty
+	{
+		std::string name;
+		PlyType type;
+		PlyType count_type = PlyType::Invalid; // type of the length of list properties
+	};
+
+	struct PlyElement
+	{
+		std::string name;
+		size_t count;
+		std::vector<PlyProperty> properties;
+	};
+
+	struct PlyHeader
+	{
+		PlyFormat format = PlyFormat::Ascii;
+		std::vector<PlyElement> elements;
+		size_t body_offset = 0;
+	};
+
+	static PlyType ply_type(const std::string& name)
+	{
+		if(name == "char" || name == "int8") return PlyType::Int8;
+		if(name == "uchar" || name == "uint8") return PlyType::UInt8;
+		if(name == "short" || name == "int16") return PlyType::Int16;
+		if(name == "ushort" || name == "uint16") return PlyType::UInt16;
+		if(name == "int" || name == "int32") return PlyType::Int32;
+		if(name == "uint" || name == "uint32") return PlyType::UInt32;
+		if(name == "float" || name == "float32") return PlyType::Float32;
+		if(name == "double" || name == "float64") return PlyType::Float64;
+		return PlyType::Invalid;
+	}
+
+	static bool parse_ply_header(const char* data,
+								 size_t size,
+								 PlyHeader& header,
+								 std::string& error)
+	{
+		static const char end_header[] = "end_header";
+		const char* end = data + size;
+		const char* header_end =
+			std::search(data, end, end_header, end_header + sizeof(end_header) - 1);
+		if(size < 3 || std::memcmp(data, "ply", 3) != 0 || header_end == end)
+		{
+			error = "not a PLY file";
+			return false;
+		}
+
+		header.body_offset = static_cast<size_t>(next_line(header_end, end) - data);
+
+		std::istringstream lines(std::string(data, header_end));
+		std::string line;
+		bool has_format = false;
+		while(std::getline(lines, line))
+		{
+			std::istringstream words(line);
+			std::string keyword;
+			words >> keyword;
+
+			if(keyword == "format")
+			{
+				std::string format;
+				words >> format;
+				if(format == "ascii")
+					header.format = PlyFormat::Ascii;
+				else if(format == "binary_little_endian")
+					header.format = PlyFormat::BinaryLittleEndian;
+				else if(format == "binary_big_endian")
+					header.format = PlyFormat::BinaryBigEndian;
+				else
+				{
+					error = "unknown format " + format;
+					return false;
+				}
+				has_format = true;
+			}
+			else if(keyword == "element")
+			{
+				PlyElement element;
+				words >> element.name >> element.count;
+				header.elements.push_back(element);
+			}
+			else if(keyword == "property")
+			{
+				if(header.elements.empty())
+				{
+					error = "property before any element";
+					return false;
+				}
+
+				PlyProperty property;
+				std::string type;
+				words >> type;
+				if(type == "list")
+				{
+					std::string count_type;
+					words >> count_type >> type;
+					property.count_type = ply_type(count_type);
+					if(property.count_type == PlyType::Invalid)
+					{
+						error = "unknown type " + count_type;
+						return false;
+					}
+				}
+
+				property.type = ply_type(type);
+				words >> property.name;
+				if(property.type == PlyType::Invalid)
+				{
+					error = "unknown type " + type;
+					return false;
+				}
+
+				header.elements.back().properties.push_back(property);
+			}
+		}
+
+		if(!has_format) error = "no format in header";
+		return has_format;
+	}
+
+	class PlyReader
+	{
+	public:
+		PlyReader(const char* begin, const char* end, PlyFormat format)
+			: cur(begin)
+			, end(end)
+			, format(format)
+		{
+			const uint16_t one = 1;
+			uint8_t first_byte;
+			std::memcpy(&first_byte, &one, 1);
+			const bool host_little_endian = first_byte == 1;
+			swap = format != PlyFormat::Ascii &&
+				   (format == PlyFormat::BinaryLittleEndian) != host_little_endian;
+		}
+
+		double read(PlyType type)
+		{
+			if(format == PlyFormat::Ascii) return read_ascii();
+
+			const size_t size = type_size(type);
+			if(static_cast<size_t>(end - cur) < size)
+			{
+				ok = false;
+				return 0.0;
+			}
+
+			unsigned char bytes[8];
+			std::memcpy(bytes, cur, size);
+			cur += size;
+			if(swap) std::reverse(bytes, bytes + size);
+
+			switch(type)
+			{
+			case PlyType::Int8: return as<int8_t>(bytes);
+			case PlyType::UInt8: return as<uint8_t>(bytes);
+			case PlyType::Int16: return as<int16_t>(bytes);
+			case PlyType::UInt16: return as<uint16_t>(bytes);
+			case PlyType::Int32: return as<int32_t>(bytes);
+			case PlyType::UInt32: return as<uint32_t>(bytes);
+			case PlyType::Float32: return as<float>(bytes);
+			case PlyType::Float64: return as<double>(bytes);
+			default: ok = false; return 0.0;
+			}
+		}
+
+		bool ok = true;
+
+	private:
+		template <typename T>
+		static double as(const unsigned char* bytes)
+		{
+			T value;
+			std::memcpy(&value, bytes, sizeof(T));
+			return static_cast<double>(value);
+		}
+
+		static size_t type_size(PlyType type)
+		{
+			switch(type)
+			{
+			case PlyType::Int8:
+			case PlyType::UInt8: return 1;
+			case PlyType::Int16:
+			case PlyType::UInt16: return 2;
+			case PlyType::Int32:
+			case PlyType::UInt32:
+			case PlyType::Float32: return 4;
+			case PlyType::Float64: return 8;
+			default: return 0;
+			}
+		}
+
+		double read_ascii()
+		{
+			while(cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r' || *cur == '\n')) cur++;
+
+			double value = 0.0;
+			auto result = std::from_chars(cur, end, value);
+			if(result.ec != std::errc())
+			{
+				ok = false;
+				return 0.0;
+			}
+
+			cur = result.ptr;
+			return value;
+		}
+
+	private:
+		const char* cur;
+		const char* end;
+		PlyFormat format;
+		bool swap;
+	};
+
+	static void read_ply_vertices(PlyReader& reader, const PlyElement& element, MeshData& mesh)
+	{
+		// where each property goes, null for ones we don't use
+		std::vector<std::vector<float>*> targets(element.properties.size(), nullptr);
+		for(size_t i = 0; i < element.properties.size(); i++)
+		{
+			if(element.properties[i].count_type != PlyType::Invalid) continue;
+
+			targets[i] = ply_vertex_target(mesh, element.properties[i].name);
+			if(targets[i]) targets[i]->resize(element.count);
+		}
+
+		for(size_t v = 0; v < element.count && reader.ok; v++)
+		{
+			for(size_t i = 0; i < element.properties.size(); i++)
+			{
+				const PlyProperty& property = element.properties[i];
+				if(property.count_type != PlyType::Invalid)
+				{
+					skip_ply_list(reader, property);
+					continue;
+				}
+
+				const double value = reader.read(property.type);
+				if(targets[i]) (*targets[i])[v] = static_cast<float>(value);
+			}
+		}
+
+		// attributes are only used if all their components are there
+		const size_t n = mesh.px.size();
+		if(mesh.nx.size() != n || mesh.ny.size() != n || mesh.nz.size() != n)
+		{
+			mesh.nx.clear();
+			mesh.ny.clear();
+			mesh.nz.clear();
+		}
+		if(mesh.tu.size() != n || mesh.tv.size() != n)
+		{
+			mesh.tu.clear();
+			mesh.tv.clear();
+		}
+	}
+
+	static std::vector<float>* ply_vertex_target(MeshData& mesh, const std::string& name)
+	{
+		if(name == "x") return &mesh.px;
+		if(name == "y") return &mesh.py;
+		if(name == "z") return &mesh.pz;
+		if(name == "nx") return &mesh.nx;
+		if(name == "ny") return &mesh.ny;
+		if(name == "nz") return &mesh.nz;
+		if(name == "u" || name == "s" || name == "texture_u" || name == "texture_s")
+			return &mesh.tu;
+		if(name == "v" || name == "t" || name == "texture_v" || name == "texture_t")
+			return &mesh.tv;
+		return nullptr;
+	}
+
+	static void read_ply_faces(PlyReader& reader, const PlyElement& element, MeshData& mesh)
+	{
+		mesh.indices.reserve(mesh.indices.size() + 3 * element.count);
+
+		std::vector<uint32_t> polygon;
+		for(size_t f = 0; f < element.count && reader.ok; f++)
+		{
+			for(const PlyProperty& property : element.properties)
+			{
+				const bool is_indices =
+					property.name == "vertex_indices" || property.name == "vertex_index";
+				if(!is_indices || property.count_type == PlyType::Invalid)
+				{
+					if(property.count_type != PlyType::Invalid)
+						skip_ply_list(reader, property);
+					else
+						reader.read(property.type);
+					continue;
+				}
+
+				const auto n = static_cast<size_t>(reader.read(property.count_type));
+				polygon.resize(n);
+				for(size_t i = 0; i < n; i++)
+					polygon[i] = static_cast<uint32_t>(reader.read(property.type));
+
+				for(size_t i = 2; i < n; i++)
+				{
+					mesh.indices.push_back(polygon[0]);
+					mesh.indices.push_back(polygon[i - 1]);
+					mesh.indices.push_back(polygon[i]);
+				}
+			}
+		}
+	}
+
+	static void skip_ply_list(PlyReader& reader, const PlyProperty& property)
+	{
+		const auto n = static_cast<size_t>(reader.read(property.count_type));
+		for(size_t i = 0; i < n && reader.ok; i++) reader.read(property.type);
+	}
+
+	static void skip_ply_element(PlyReader& reader, const PlyElement& element)
+	{
+		for(size_t e = 0; e < element.count && reader.ok; e++)
+		{
+			for(const PlyProperty& property : element.properties)
+			{
+				if(property.count_type != PlyType::Invalid)
+					skip_ply_list(reader, property);
+				else
+					reader.read(property.type);
+			}
+		}
+	}
+
+	/*
+	 *  OBJ
+	 *
+	 *  Face indices count from the start of the file, or back from the
+	 *  current vertex when negative. A chunk doesn't know how many vertices
+	 *  come before it, so negative indices are stored relative to the start
+	 *  of the chunk and tagged, then made absolute when the chunks are
+	 *  joined.
+	 */
+
+	static constexpr int64_t obj_none = -1;
+	static constexpr int64_t obj_relative = int64_t(1) << 62;
+
+	struct ObjCounts
+	{
+		size_t positions = 0, normals = 0, uvs = 0, triangles = 0;
+	};
+
+	struct ObjChunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<float> px, py, pz, nx, ny, nz, tu, tv;
+		std::vector<int64_t> corners; // position, uv and normal index of each triangle corner
+		bool all_normals = true; // every corner has a normal index
+		bool all_uvs = true;
+		bool error = false;
+
+		ObjCounts offsets; // of this chunk's data in the whole file
+
+		// frees the parsed data once it has been copied into the mesh
+		void release()
+		{
+			for(auto* v : {&px, &py, &pz, &nx, &ny, &nz, &tu, &tv}) std::vector<float>().swap(*v);
+			std::vector<int64_t>().swap(corners);
+		}
+	};
+
+	static void skip_blanks(const char*& p, const char* end)
+	{
+		while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	}
+
+	static bool parse_float(const char*& p, const char* end, float& value)
+	{
+		skip_blanks(p, end);
+		if(p < end && *p == '+') p++;
+
+		auto result = std::from_chars(p, end, value);
+		if(result.ec != std::errc()) return false;
+
+		p = result.ptr;
+		return true;
+	}
+
+	static bool parse_index(const char*& p, const char* end, int64_t& value)
+	{
+		auto result = std::from_chars(p, end, value);
+		if(result.ec != std::errc() || value == 0) return false;
+
+		p = result.ptr;
+		return true;
+	}
+
+	// turns an index from the file into an absolute one, or a tagged chunk relative one
+	static int64_t obj_index(int64_t index, size_t count_so_far)
+	{
+		return index > 0 ? index - 1 : obj_relative + static_cast<int64_t>(count_so_far) + index;
+	}
+
+	static void parse_obj_chunk(ObjChunk& chunk)
+	{
+		std::vector<int64_t> polygon;
+		for(const char* line = chunk.begin; line < chunk.end && !chunk.error;)
+		{
+			const char* line_end = next_line(line, chunk.end);
+			const char* p = line;
+			skip_blanks(p, line_end);
+
+			if(line_end - p > 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+			{
+				float x = 0.f, y = 0.f, z = 0.f;
+				p++;
+				chunk.error = !(parse_float(p, line_end, x) && parse_float(p, line_end, y) &&
+								parse_float(p, line_end, z));
+				chunk.px.push_back(x);
+				chunk.py.push_back(y);
+				chunk.pz.push_back(z);
+			}
+			else if(line_end - p > 3 && p[0] == 'v' && p[1] == 'n')
+			{
+				float x = 0.f, y = 0.f, z = 0.f;
+				p += 2;
+				chunk.error = !(parse_float(p, line_end, x) && parse_float(p, line_end, y) &&
+								parse_float(p, line_end, z));
+				chunk.nx.push_back(x);
+				chunk.ny.push_back(y);
+				chunk.nz.push_back(z);
+			}
+			else if(line_end - p > 3 && p[0] == 'v' && p[1] == 't')
+			{
+				float u = 0.f, v = 0.f;
+				p += 2;
+				chunk.error = !parse_float(p, line_end, u);
+				if(!parse_float(p, line_end, v)) v = 0.f; // 1D texture coordinates
+				chunk.tu.push_back(u);
+				chunk.tv.push_back(v);
+			}
+			else if(line_end - p > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+			{
+				p++;
+				polygon.clear();
+				while(true)
+				{
+					skip_blanks(p, line_end);
+					if(p == line_end || *p == '\n' || *p == '#') break;
+
+					// v, v/vt, v//vn or v/vt/vn
+					int64_t v, vt = 0, vn = 0;
+					if(!parse_index(p, line_end, v))
+					{
+						chunk.error = true;
+						break;
+					}
+					if(p < line_end && *p == '/')
+					{
+						p++;
+						if(p < line_end && *p != '/' && !parse_index(p, line_end, vt))
+							chunk.error = true;
+						if(p < line_end && *p == '/')
+						{
+							p++;
+							if(!parse_index(p, line_end, vn)) chunk.error = true;
+						}
+					}
+
+					polygon.push_back(obj_index(v, chunk.px.size()));
+					polygon.push_back(vt ? obj_index(vt, chunk.tu.size()) : obj_none);
+					polygon.push_back(vn ? obj_index(vn, chunk.nx.size()) : obj_none);
+					chunk.all_uvs &= vt != 0;
+					chunk.all_normals &= vn != 0;
+				}
+
+				if(polygon.size() < 9) chunk.error = true;
+				for(size_t i = 6; i < polygon.size() && !chunk.error; i += 3)
+				{
+					chunk.corners.insert(chunk.corners.end(), polygon.begin(), polygon.begin() + 3);
+					chunk.corners.insert(
+						chunk.corners.end(), polygon.begin() + i - 3, polygon.begin() + i + 3);
+				}
+			}
+
+			line = line_end;
+		}
+	}
+
+	// copies a parsed chunk into its place in the mesh, resolving its indices
+	static void copy_obj_chunk(ObjChunk& chunk,
+							   const ObjCounts& total,
+							   bool use_normals,
+							   bool use_uvs,
+							   MeshData& mesh)
+	{
+		const ObjCounts& at = chunk.offsets;
+		std::copy(chunk.px.begin(), chunk.px.end(), mesh.px.begin() + at.positions);
+		std::copy(chunk.py.begin(), chunk.py.end(), mesh.py.begin() + at.positions);
+		std::copy(chunk.pz.begin(), chunk.pz.end(), mesh.pz.begin() + at.positions);
+		if(use_normals)
+		{
+			std::copy(chunk.nx.begin(), chunk.nx.end(), mesh.nx.begin() + at.normals);
+			std::copy(chunk.ny.begin(), chunk.ny.end(), mesh.ny.begin() + at.normals);
+			std::copy(chunk.nz.begin(), chunk.nz.end(), mesh.nz.begin() + at.normals);
+		}
+		if(use_uvs)
+		{
+			std::copy(chunk.tu.begin(), chunk.tu.end(), mesh.tu.begin() + at.uvs);
+			std::copy(chunk.tv.begin(), chunk.tv.end(), mesh.tv.begin() + at.uvs);
+		}
+
+		auto resolve = [&chunk](int64_t index, size_t offset, size_t count) {
+			if(index >= obj_relative / 2)
+				index = static_cast<int64_t>(offset) + (index - obj_relative);
+			if(index < 0 || index >= static_cast<int64_t>(count))
+			{
+				chunk.error = true;
+				return uint32_t(0);
+			}
+			return static_cast<uint32_t>(index);
+		};
+
+		const size_t num_corners = chunk.corners.size() / 3;
+		for(size_t i = 0; i < num_corners; i++)
+		{
+			const size_t out = 3 * at.triangles + i;
+			mesh.indices[out] = resolve(chunk.corners[3 * i], at.positions, total.positions);
+			if(use_uvs) mesh.uv_indices[out] = resolve(chunk.corners[3 * i + 1], at.uvs, total.uvs);
+			if(use_normals)
+				mesh.normal_indices[out] =
+					resolve(chunk.corners[3 * i + 2], at.normals, total.normals);
+		}
+
+		chunk.release();
+	}
+};
@@ -1,19 +1,19 @@
 #pragma once
 
 #include "hittable.h"
-#include "material.h"
+#include "util.h"
 
 class MovingSphere : public Hittable
 {
 public:
 	MovingSphere() = default;
-	MovingSphere(vec3 cen0, vec3 cen1, float t0, float t1, float r, std::shared_ptr<Material> m)
+	MovingSphere(vec3 cen0, vec3 cen1, float t0, float t1, float r, MaterialId m)
 		: centre0(cen0)
 		, centre1(cen1)
 		, time0(t0)
 		, time1(t1)
 		, radius(r)
-		, mat_ptr(m)
+		, material(m)
 	{}
 
 	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
@@ -30,9 +30,9 @@ public:
 			if(temp < t_max && temp > t_min)
 			{
 				rec.t = temp;
-				rec.p = r.point_at_parameter(rec.t);
-				rec.normal = (rec.p - centre(r.time())) / radius;
-				rec.mat_ptr = mat_ptr;
+				rec.local = oc + temp * r.direction();
+				rec.normal = rec.local / radius;
+				rec.object = this;
 				return true;
 			}
 
@@ -40,9 +40,9 @@ public:
 			if(temp < t_max && temp > t_min)
 			{
 				rec.t = temp;
-				rec.p = r.point_at_parameter(rec.t);
-				rec.normal = (rec.p - centre(r.time())) / radius;
-				rec.mat_ptr = mat_ptr;
+				rec.local = oc + temp * r.direction();
+				rec.normal = rec.local / radius;
+				rec.object = this;
 				return true;
 			}
 		}
@@ -50,13 +50,36 @@ public:
 		return false;
 	}
 
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		vec3 oc = r.origin() - centre(r.time());
+		float a = dot(r.direction(), r.direction());
+		float b = dot(oc, r.direction());
+		float c = dot(oc, oc) - radius * radius;
+		float discriminant = b * b - a * c;
+		if(discriminant <= 0.f) return false;
+
+		float root = sqrt(discriminant);
+		float temp = (-b - root) / a;
+		if(temp < t_max && temp > t_min) return true;
+
+		temp = (-b + root) / a;
+		return temp < t_max && temp > t_min;
+	}
+
+	// local is relative to the centre
+	virtual void surface(HitRecord& rec) const override
+	{
+		Util::get_sphere_uv(rec.local / radius, rec.u, rec.v);
+		rec.material = material;
+	}
+
 	virtual bool bounding_box(float t0, float t1, AABB& box) const override
 	{
-		AABB box_start =
-			AABB(centre0 - vec3(radius, radius, radius), centre1 + vec3(radius, radius, radius));
-		AABB box_end =
-			AABB(centre1 - vec3(radius, radius, radius), centre1 + vec3(radius, radius, radius));
-		box = AABB::surrounding_box(box_start, box_end);
+		// the centre moves in a straight line, so the ends of the interval bound it
+		const vec3 extent(fabs(radius), fabs(radius), fabs(radius));
+		box = AABB(centre(t0) - extent, centre(t0) + extent);
+		box.grow(AABB(centre(t1) - extent, centre(t1) + extent));
 
 		return true;
 	}
@@ -70,5 +93,5 @@ private:
 	vec3 centre0, centre1;
 	float time0, time1;
 	float radius;
-	std::shared_ptr<Material> mat_ptr;
+	MaterialId material;
 };
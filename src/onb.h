@@ -0,0 +1,32 @@
+#pragma once
+
+#include "vec3.h"
+
+#include <cmath>
+
+/*
+ *  Orthonormal basis built around a direction, used to turn directions
+ *  sampled around the z axis into directions around an arbitrary one.
+ */
+
+class ONB
+{
+public:
+	explicit ONB(const vec3& n)
+	{
+		axis[2] = unit_vector(n);
+		vec3 a = (fabs(axis[2].x()) > 0.9f) ? vec3(0.f, 1.f, 0.f) : vec3(1.f, 0.f, 0.f);
+		axis[1] = unit_vector(cross(axis[2], a));
+		axis[0] = cross(axis[2], axis[1]);
+	}
+
+	const vec3& u() const { return axis[0]; }
+	const vec3& v() const { return axis[1]; }
+	const vec3& w() const { return axis[2]; }
+
+	vec3 local(float a, float b, float c) const { return a * u() + b * v() + c * w(); }
+	vec3 local(const vec3& a) const { return a.x() * u() + a.y() * v() + a.z() * w(); }
+
+private:
+	vec3 axis[3];
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "sampler.h"
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+/*
+ *  Everything about a render that can change between jobs without a
+ *  rebuild. Options are given on the command line as --key value or
+ *  --key=value, or in a config file of key = value lines (# starts a
+ *  comment) loaded with --config; later options override earlier ones, so
+ *  a command line can adjust a config file it names first.
+ */
+
+struct RenderOptions
+{
+	std::string scene = "cornell_box";
+	int width = 600;
+	int height = 300;
+	int samples = 100;   // per pixel, or per batch when sampling adaptively
+	int max_samples = 0; // adaptive sampling is off if this isn't above samples
+	float threshold = 0.01f;
+	int max_depth = 50;
+	unsigned threads = 0; // every core
+	std::string output = "out.png";
+	std::string spp_output; // map of the samples taken per pixel, if set
+	std::string cache;      // directory for BVH caches of scene files, if set
+	uint64_t seed = std::random_device{}();
+	SampleSequence sequence = SampleSequence::Sobol;
+
+	// prints what went wrong and returns false on a bad or unknown option;
+	// help is set if usage was asked for
+	bool parse(int argc, char** argv, bool& help)
+	{
+		help = false;
+		for(int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if(arg == "-h" || arg == "--help")
+			{
+				help = true;
+				return true;
+			}
+			if(arg.compare(0, 2, "--") != 0)
+			{
+				std::cerr << "Unexpected argument '" << arg << "'\n";
+				return false;
+			}
+
+			std::string key = arg.substr(2), value;
+			const size_t equals = key.find('=');
+			if(equals != std::string::npos)
+			{
+				value = key.substr(equals + 1);
+				key.erase(equals);
+			}
+			else if(i + 1 < argc)
+			{
+				value = argv[++i];
+			}
+			else
+			{
+				std::cerr << "No value for option '" << key << "'\n";
+				return false;
+			}
+
+			if(!(key == "config" ? load(value) : set(key, value))) return false;
+		}
+
+		return true;
+	}
+
+	bool load(const std::string& path)
+	{
+		std::ifstream file(path);
+		if(!file)
+		{
+			std::cerr << "Could not open config file '" << path << "'\n";
+			return false;
+		}
+
+		std::string line;
+		for(int number = 1; std::getline(file, line); number++)
+		{
+			line = trim(line.substr(0, line.find('#')));
+			if(line.empty()) continue;
+
+			const size_t equals = line.find('=');
+			if(equals == std::string::npos)
+			{
+				std::cerr << path << ":" << number << ": expected key = value\n";
+				return false;
+			}
+			if(!set(trim(line.substr(0, equals)), trim(line.substr(equals + 1)))) return false;
+		}
+
+		return true;
+	}
+
+	bool set(const std::string& key, const std::string& value)
+	{
+		bool ok = true;
+		if(key == "scene")
+			scene = value;
+		else if(key == "width")
+			ok = to_int(value, 1, width);
+		else if(key == "height")
+			ok = to_int(value, 1, height);
+		else if(key == "samples")
+			ok = to_int(value, 1, samples);
+		else if(key == "max-samples")
+			ok = to_int(value, 0, max_samples);
+		else if(key == "threshold")
+			ok = to_float(value, threshold);
+		else if(key == "depth")
+			ok = to_int(value, 0, max_depth);
+		else if(key == "threads")
+		{
+			int n = 0;
+			ok = to_int(value, 0, n);
+			threads = static_cast<unsigned>(n);
+		}
+		else if(key == "output")
+			output = value;
+		else if(key == "spp-output")
+			spp_output = value;
+		else if(key == "cache")
+			cache = value;
+		else if(key == "seed")
+			ok = to_seed(value, seed);
+		else if(key == "sampler")
+			ok = to_sequence(value, sequence);
+		else
+		{
+			std::cerr << "Unknown option '" << key << "'\n";
+			return false;
+		}
+
+		if(!ok) std::cerr << "Bad value '" << value << "' for option '" << key << "'\n";
+		return ok;
+	}
+
+	static void usage(std::ostream& os, const char* program)
+	{
+		os << "Usage: " << program << " [--key value | --key=value]...\n"
+		   << "  --config <path>      read options from a file of key = value lines\n"
+		   << "  --scene <name|path>  built in scene or scene file to render (cornell_box)\n"
+		   << "  --width <pixels>     image width (600)\n"
+		   << "  --height <pixels>    image height (300)\n"
+		   << "  --samples <n>        samples per pixel, or per batch if adaptive (100)\n"
+		   << "  --max-samples <n>    adaptive sampling limit, 0 for a fixed count (0)\n"
+		   << "  --threshold <error>  adaptive sampling target error (0.01)\n"
+		   << "  --depth <n>          maximum path length (50)\n"
+		   << "  --threads <n>        worker threads, 0 for every core (0)\n"
+		   << "  --output <path>      PNG image to write (out.png)\n"
+		   << "  --spp-output <path>  PNG map of the samples taken per pixel (none)\n"
+		   << "  --cache <directory>  where to cache the BVHs of scene files (none)\n"
+		   << "  --seed <n>           random seed (random)\n"
+		   << "  --sampler <name>     independent, sobol or halton (sobol)\n";
+	}
+
+private:
+	static std::string trim(const std::string& s)
+	{
+		const size_t first = s.find_first_not_of(" \t\r");
+		if(first == std::string::npos) return std::string();
+		return s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+	}
+
+	static bool to_int(const std::string& s, int min, int& out)
+	{
+		size_t end = 0;
+		try
+		{
+			const int n = std::stoi(s, &end);
+			if(end != s.size() || n < min) return false;
+			out = n;
+			return true;
+		}
+		catch(const std::exception&)
+		{
+			return false;
+		}
+	}
+
+	static bool to_float(const std::string& s, float& out)
+	{
+		size_t end = 0;
+		try
+		{
+			const float f = std::stof(s, &end);
+			if(end != s.size() || !(f >= 0.f)) return false;
+			out = f;
+			return true;
+		}
+		catch(const std::exception&)
+		{
+			return false;
+		}
+	}
+
+	static bool to_seed(const std::string& s, uint64_t& out)
+	{
+		size_t end = 0;
+		try
+		{
+			const unsigned long long n = std::stoull(s, &end);
+			if(end != s.size()) return false;
+			out = n;
+			return true;
+		}
+		catch(const std::exception&)
+		{
+			return false;
+		}
+	}
+
+	static bool to_sequence(const std::string& s, SampleSequence& out)
+	{
+		if(s == "independent")
+			out = SampleSequence::Independent;
+		else if(s == "sobol")
+			out = SampleSequence::Sobol;
+		else if(s == "halton")
+			out = SampleSequence::Halton;
+		else
+			return false;
+		return true;
+	}
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// the number of threads to use when asked for 0, meaning all of them
+inline unsigned default_num_threads(unsigned num_threads)
+{
+	return num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// runs f(0) .. f(n - 1) on n threads, one of them the calling thread
+template <typename F>
+void parallel_for(size_t n, F&& f)
+{
+	std::vector<std::thread> threads;
+	threads.reserve(n);
+	for(size_t i = 1; i < n; i++) threads.emplace_back([&f, i]() { f(i); });
+
+	if(n > 0) f(0);
+	for(auto& t : threads) t.join();
+}
@@ -2,6 +2,8 @@
 
 #include "vec3.h"
 
+#include <cstdint>
+
 class Ray
 {
 public:
@@ -10,15 +12,23 @@ public:
 		: A(a)
 		, B(b)
 		, _time(ti)
+		, inv_B(1.f / b.x(), 1.f / b.y(), 1.f / b.z())
+		, _sign{inv_B.x() < 0.f, inv_B.y() < 0.f, inv_B.z() < 0.f}
 	{}
 
-	vec3 origin() const { return A; }
-	vec3 direction() const { return B; }
+	const vec3& origin() const { return A; }
+	const vec3& direction() const { return B; }
 	float time() const { return _time; }
 
+	// precomputed once per ray for the slab tests done during traversal
+	const vec3& inv_direction() const { return inv_B; }
+	int sign(int axis) const { return _sign[axis]; } // 1 if the direction is negative
+
 	vec3 point_at_parameter(float t) const { return A + t * B; }
 
 private:
 	vec3 A, B;
 	float _time;
+	vec3 inv_B;
+	uint8_t _sign[3];
 };
@@ -2,21 +2,21 @@
 
 #include "aabb.h"
 #include "hittable.h"
-#include "material.h"
 
+#include <limits>
 #include <memory>
 
 class XYRect : public Hittable
 {
 public:
 	XYRect() = default;
-	XYRect(float _x0, float _x1, float _y0, float _y1, float _k, std::shared_ptr<Material> m)
+	XYRect(float _x0, float _x1, float _y0, float _y1, float _k, MaterialId m)
 		: x0(_x0)
 		, x1(_x1)
 		, y0(_y0)
 		, y1(_y1)
 		, k(_k)
-		, mat_ptr(m)
+		, material(m)
 	{}
 
 	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
@@ -28,38 +28,72 @@ public:
 		float y = r.origin().y() + t * r.direction().y();
 		if(x < x0 || x > x1 || y < y0 || y > y1) return false;
 
-		rec.u = (x - x0) / (x1 - x0);
-		rec.v = (y - y0) / (y1 - y0);
 		rec.t = t;
-		rec.mat_ptr = mat_ptr;
-		rec.p = r.point_at_parameter(t);
 		rec.normal = vec3(0.f, 0.f, 1.f);
+		rec.local = vec3(x, y, k);
+		rec.object = this;
 
 		return true;
 	}
 
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		float t = (k - r.origin().z()) / r.direction().z();
+		if(t < t_min || t > t_max) return false;
+
+		float x = r.origin().x() + t * r.direction().x();
+		float y = r.origin().y() + t * r.direction().y();
+		return !(x < x0 || x > x1 || y < y0 || y > y1);
+	}
+
+	virtual void surface(HitRecord& rec) const override
+	{
+		rec.u = (rec.local.x() - x0) / (x1 - x0);
+		rec.v = (rec.local.y() - y0) / (y1 - y0);
+		rec.material = material;
+	}
+
 	virtual bool bounding_box(float t0, float t1, AABB& box) const override
 	{
 		box = AABB(vec3(x0, y0, k - 0.0001f), vec3(x1, y1, k + 0.0001f));
 		return true;
 	}
 
+	virtual float pdf_value(const vec3& origin, const vec3& direction) const override
+	{
+		HitRecord rec;
+		if(!hit(Ray(origin, direction), 0.001f, std::numeric_limits<float>::max(), rec))
+			return 0.f;
+
+		float area = (x1 - x0) * (y1 - y0);
+		float distance_squared = rec.t * rec.t * direction.squared_length();
+		float cosine = fabs(dot(direction, rec.normal) / direction.length());
+
+		return distance_squared / (cosine * area);
+	}
+
+	virtual vec3 random(const vec3& origin, Sampler& sampler) const override
+	{
+		vec3 on_light(x0 + sampler.next_float() * (x1 - x0), y0 + sampler.next_float() * (y1 - y0), k);
+		return on_light - origin;
+	}
+
 private:
 	float x0, x1, y0, y1, k;
-	std::shared_ptr<Material> mat_ptr;
+	MaterialId material;
 };
 
 class XZRect : public Hittable
 {
 public:
 	XZRect() = default;
-	XZRect(float _x0, float _x1, float _z0, float _z1, float _k, std::shared_ptr<Material> m)
+	XZRect(float _x0, float _x1, float _z0, float _z1, float _k, MaterialId m)
 		: x0(_x0)
 		, x1(_x1)
 		, z0(_z0)
 		, z1(_z1)
 		, k(_k)
-		, mat_ptr(m)
+		, material(m)
 	{}
 
 	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
@@ -71,38 +105,72 @@ public:
 		float z = r.origin().z() + t * r.direction().z();
 		if(x < x0 || x > x1 || z < z0 || z > z1) return false;
 
-		rec.u = (x - x0) / (x1 - x0);
-		rec.v = (z - z0) / (z1 - z0);
 		rec.t = t;
-		rec.mat_ptr = mat_ptr;
-		rec.p = r.point_at_parameter(t);
 		rec.normal = vec3(0.f, 1.f, 0.f);
+		rec.local = vec3(x, k, z);
+		rec.object = this;
 
 		return true;
 	}
 
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		float t = (k - r.origin().y()) / r.direction().y();
+		if(t < t_min || t > t_max) return false;
+
+		float x = r.origin().x() + t * r.direction().x();
+		float z = r.origin().z() + t * r.direction().z();
+		return !(x < x0 || x > x1 || z < z0 || z > z1);
+	}
+
+	virtual void surface(HitRecord& rec) const override
+	{
+		rec.u = (rec.local.x() - x0) / (x1 - x0);
+		rec.v = (rec.local.z() - z0) / (z1 - z0);
+		rec.material = material;
+	}
+
 	virtual bool bounding_box(float t0, float t1, AABB& box) const override
 	{
 		box = AABB(vec3(x0, k - 0.0001f, z0), vec3(x1, k + 0.0001f, z1));
 		return true;
 	}
 
+	virtual float pdf_value(const vec3& origin, const vec3& direction) const override
+	{
+		HitRecord rec;
+		if(!hit(Ray(origin, direction), 0.001f, std::numeric_limits<float>::max(), rec))
+			return 0.f;
+
+		float area = (x1 - x0) * (z1 - z0);
+		float distance_squared = rec.t * rec.t * direction.squared_length();
+		float cosine = fabs(dot(direction, rec.normal) / direction.length());
+
+		return distance_squared / (cosine * area);
+	}
+
+	virtual vec3 random(const vec3& origin, Sampler& sampler) const override
+	{
+		vec3 on_light(x0 + sampler.next_float() * (x1 - x0), k, z0 + sampler.next_float() * (z1 - z0));
+		return on_light - origin;
+	}
+
 private:
 	float x0, x1, z0, z1, k;
-	std::shared_ptr<Material> mat_ptr;
+	MaterialId material;
 };
 
 class YZRect : public Hittable
 {
 public:
 	YZRect() = default;
-	YZRect(float _y0, float _y1, float _z0, float _z1, float _k, std::shared_ptr<Material> m)
+	YZRect(float _y0, float _y1, float _z0, float _z1, float _k, MaterialId m)
 		: y0(_y0)
 		, y1(_y1)
 		, z0(_z0)
 		, z1(_z1)
 		, k(_k)
-		, mat_ptr(m)
+		, material(m)
 	{}
 
 	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
@@ -114,23 +182,57 @@ public:
 		float z = r.origin().z() + t * r.direction().z();
 		if(y < y0 || y > y1 || z < z0 || z > z1) return false;
 
-		rec.u = (y - y0) / (y1 - y0);
-		rec.v = (z - z0) / (z1 - z0);
 		rec.t = t;
-		rec.mat_ptr = mat_ptr;
-		rec.p = r.point_at_parameter(t);
 		rec.normal = vec3(1.f, 0.f, 0.f);
+		rec.local = vec3(k, y, z);
+		rec.object = this;
 
 		return true;
 	}
 
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		float t = (k - r.origin().x()) / r.direction().x();
+		if(t < t_min || t > t_max) return false;
+
+		float y = r.origin().y() + t * r.direction().y();
+		float z = r.origin().z() + t * r.direction().z();
+		return !(y < y0 || y > y1 || z < z0 || z > z1);
+	}
+
+	virtual void surface(HitRecord& rec) const override
+	{
+		rec.u = (rec.local.y() - y0) / (y1 - y0);
+		rec.v = (rec.local.z() - z0) / (z1 - z0);
+		rec.material = material;
+	}
+
 	virtual bool bounding_box(float t0, float t1, AABB& box) const override
 	{
 		box = AABB(vec3(k - 0.0001f, y0, z0), vec3(k + 0.0001f, y1, z1));
 		return true;
 	}
 
+	virtual float pdf_value(const vec3& origin, const vec3& direction) const override
+	{
+		HitRecord rec;
+		if(!hit(Ray(origin, direction), 0.001f, std::numeric_limits<float>::max(), rec))
+			return 0.f;
+
+		float area = (y1 - y0) * (z1 - z0);
+		float distance_squared = rec.t * rec.t * direction.squared_length();
+		float cosine = fabs(dot(direction, rec.normal) / direction.length());
+
+		return distance_squared / (cosine * area);
+	}
+
+	virtual vec3 random(const vec3& origin, Sampler& sampler) const override
+	{
+		vec3 on_light(k, y0 + sampler.next_float() * (y1 - y0), z0 + sampler.next_float() * (z1 - z0));
+		return on_light - origin;
+	}
+
 private:
 	float y0, y1, z0, z1, k;
-	std::shared_ptr<Material> mat_ptr;
+	MaterialId material;
 };
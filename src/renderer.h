@@ -0,0 +1,206 @@
+#pragma once
+
+#include "camera.h"
+#include "hittable.h"
+#include "integrator.h"
+#include "sampler.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+/*
+ *  Splits the image into square tiles and renders them on a pool of worker
+ *  threads. Workers grab the next tile from a shared atomic counter and write
+ *  straight into the output buffer; tiles never overlap so no locking is needed.
+ *  Each worker owns a Sampler which is reseeded per tile and started on each
+ *  pixel sample, so the image only depends on the seed and not on which
+ *  thread happened to render a tile.
+ *
+ *  With adaptive sampling on, num_samples is the batch a pixel is sampled
+ *  in. After each batch a running (Welford) mean and variance of the pixel's
+ *  luminance give the standard error of its value; once that error, taken
+ *  through the gamma curve the image is stored with, is below the threshold
+ *  the pixel is done, otherwise it gets another batch up to max_samples.
+ *  Flat, well lit pixels stop early and the budget goes to the noisy ones.
+ */
+
+class Renderer
+{
+public:
+	static constexpr int num_channels = 3;
+
+	Renderer(int width,
+			 int height,
+			 int num_samples,
+			 int tile_size = 16,
+			 unsigned num_threads = 0,
+			 uint64_t seed = std::random_device{}(),
+			 SampleSequence sequence = SampleSequence::Sobol)
+		: _width(width)
+		, _height(height)
+		, _num_samples(num_samples)
+		, _tile_size(tile_size)
+		, _num_threads(num_threads)
+		, _seed(seed)
+		, _sequence(sequence)
+	{
+		// 0 means "use every core the machine has"
+		if(_num_threads == 0) _num_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	unsigned num_threads() const { return _num_threads; }
+
+	// threshold is the standard error allowed in a gamma corrected value in [0, 1]
+	void set_adaptive(int max_samples, float threshold)
+	{
+		_max_samples = max_samples;
+		_threshold = threshold;
+	}
+
+	// samples_used, if given, receives the number of samples taken for each
+	// pixel, in the image's row order
+	std::vector<unsigned char> render(const Camera& cam,
+									  const Scene& scene,
+									  const PathTracer& integrator = PathTracer(),
+									  std::vector<int>* samples_used = nullptr) const
+	{
+		std::vector<unsigned char> image(static_cast<size_t>(_width * _height * num_channels));
+		if(samples_used) samples_used->assign(static_cast<size_t>(_width * _height), 0);
+
+		const int tiles_x = (_width + _tile_size - 1) / _tile_size;
+		const int tiles_y = (_height + _tile_size - 1) / _tile_size;
+		const int num_tiles = tiles_x * tiles_y;
+		std::atomic<int> next_tile(0);
+
+		auto worker = [&]() {
+			Sampler sampler(_sequence, _seed);
+
+			for(int tile = next_tile++; tile < num_tiles; tile = next_tile++)
+			{
+				sampler.reseed(_seed, static_cast<uint64_t>(tile));
+
+				const int x0 = (tile % tiles_x) * _tile_size;
+				const int y0 = (tile / tiles_x) * _tile_size;
+				const int x1 = std::min(x0 + _tile_size, _width);
+				const int y1 = std::min(y0 + _tile_size, _height);
+
+				for(int row = y0; row < y1; row++)
+				{
+					for(int column = x0; column < x1; column++)
+					{
+						int n = 0;
+						vec3 col = render_pixel(cam, scene, integrator, sampler, column, row, n);
+						write_pixel(image, column, row, col);
+						if(samples_used) (*samples_used)[flipped_index(column, row)] = n;
+					}
+				}
+			}
+		};
+
+		std::vector<std::thread> pool;
+		pool.reserve(_num_threads - 1);
+		for(unsigned i = 1; i < _num_threads; i++) pool.emplace_back(worker);
+
+		// the calling thread does its share of the work as well
+		worker();
+
+		for(auto& thread : pool) thread.join();
+
+		return image;
+	}
+
+	// greyscale image of the samples taken per pixel, white at max_samples
+	std::vector<unsigned char> samples_image(const std::vector<int>& samples_used) const
+	{
+		const int max_samples = std::max(_num_samples, _max_samples);
+		std::vector<unsigned char> image(samples_used.size() * num_channels);
+		for(size_t i = 0; i < samples_used.size(); i++)
+		{
+			const auto grey = static_cast<unsigned char>(255 * samples_used[i] / max_samples);
+			for(int c = 0; c < num_channels; c++) image[i * num_channels + c] = grey;
+		}
+		return image;
+	}
+
+private:
+	// averages samples of the pixel, in batches of num_samples while it is
+	// still noisy if sampling is adaptive, and sets n to how many were taken
+	vec3 render_pixel(const Camera& cam,
+					  const Scene& scene,
+					  const PathTracer& integrator,
+					  Sampler& sampler,
+					  int column,
+					  int row,
+					  int& n) const
+	{
+		vec3 sum(0.f, 0.f, 0.f);
+		double mean = 0.0, m2 = 0.0;
+		const int max_samples = std::max(_num_samples, _max_samples);
+		for(n = 0; n < max_samples;)
+		{
+			for(int end = std::min(n + _num_samples, max_samples); n < end; n++)
+			{
+				sampler.start_pixel_sample(column, row, n);
+				float u = (float(column) + sampler.next_float()) / float(_width);
+				float v = (float(row) + sampler.next_float()) / float(_height);
+
+				Ray r = cam.get_ray(u, v, sampler);
+				const vec3 c = integrator.colour(r, scene, sampler);
+				sum += c;
+
+				const double y = 0.2126 * c.r() + 0.7152 * c.g() + 0.0722 * c.b();
+				const double delta = y - mean;
+				mean += delta / (n + 1);
+				m2 += delta * (y - mean);
+			}
+
+			if(_max_samples <= _num_samples || converged(mean, m2, n)) break;
+		}
+
+		return sum / float(n);
+	}
+
+	// the value is stored as sqrt(mean), whose error is about the mean's
+	// standard error over 2 sqrt(mean)
+	bool converged(double mean, double m2, int n) const
+	{
+		if(n < 2) return false;
+
+		const double variance = m2 / (n - 1);
+		const double error = std::sqrt(variance / n) / (2.0 * std::sqrt(std::max(mean, 1e-4)));
+		return error < _threshold;
+	}
+
+	size_t flipped_index(int column, int row) const
+	{
+		return static_cast<size_t>(column + (_height - row - 1) * _width);
+	}
+
+	// gamma corrects the colour and stores it, flipping the image vertically;
+	// components above one are clipped rather than wrapping around
+	void write_pixel(std::vector<unsigned char>& image, int column, int row, vec3 col) const
+	{
+		col = vec3(sqrt(ffmin(col[0], 1.f)), sqrt(ffmin(col[1], 1.f)), sqrt(ffmin(col[2], 1.f)));
+
+		const auto idx = flipped_index(column, row) * num_channels;
+		image[idx + 0] = static_cast<unsigned char>(int(255.99f * col.r()));
+		image[idx + 1] = static_cast<unsigned char>(int(255.99f * col.g()));
+		image[idx + 2] = static_cast<unsigned char>(int(255.99f * col.b()));
+	}
+
+private:
+	int _width, _height;
+	int _num_samples;
+	int _tile_size;
+	unsigned _num_threads;
+	uint64_t _seed;
+	SampleSequence _sequence;
+	int _max_samples = 0; // adaptive sampling is off unless this is above num_samples
+	float _threshold = 0.f;
+};
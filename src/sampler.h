@@ -0,0 +1,287 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ *  Source of the sample values used to render a pixel. Every value drawn
+ *  with next_float() belongs to a dimension of the pixel's sample: the
+ *  first ones jitter the position in the pixel, the next ones the lens and
+ *  time, then each bounce has its own (see PathTracer). The sequence the
+ *  values come from is chosen when the sampler is made:
+ *
+ *  - Independent: uniform random numbers from xoshiro128+ (16 bytes of
+ *    state) seeded through splitmix64, no relation between samples.
+ *  - Sobol: the first four Sobol dimensions, padded to any number of
+ *    dimensions by giving every group of four its own shuffle of the
+ *    sample indices, with hash based Owen scrambling per pixel (Burley,
+ *    "Practical Hash-based Owen Scrambling", 2020).
+ *  - Halton: radical inverses in the first primes, Owen scrambled per pixel
+ *    with hashed digit permutations; dimensions past the table are random.
+ *
+ *  The low discrepancy sequences spread the samples of a pixel evenly in
+ *  every dimension, so the same noise level needs fewer of them.
+ *  A Sampler is not thread safe - every worker thread owns its own.
+ */
+
+enum class SampleSequence
+{
+	Independent,
+	Sobol,
+	Halton
+};
+
+class Sampler
+{
+public:
+	explicit Sampler(uint64_t seed = 0) { reseed(seed); }
+	Sampler(SampleSequence sequence, uint64_t seed)
+		: _sequence(sequence)
+	{
+		reseed(seed);
+	}
+
+	// restarts the sequence, the stream index lets several independent
+	// sequences (e.g. one per tile) be derived from the same seed
+	void reseed(uint64_t seed, uint64_t stream = 0)
+	{
+		_seed = static_cast<uint32_t>(seed ^ (seed >> 32));
+		uint64_t x = seed ^ (stream * 0x9e3779b97f4a7c15ull);
+		for(auto& word : state)
+		{
+			word = static_cast<uint32_t>(splitmix64(x) >> 32);
+		}
+	}
+
+	SampleSequence sequence() const { return _sequence; }
+
+	// moves to the index'th sample of a pixel, starting at its first dimension
+	void start_pixel_sample(uint32_t x, uint32_t y, uint32_t index)
+	{
+		pixel_seed = hash(hash(_seed ^ hash(x)) ^ y);
+		sample_index = index;
+		reversed_index = reverse_bits(index);
+		group = ~0u;
+		dimension = 0;
+	}
+
+	// skips to a dimension, so each part of a path always draws the same ones
+	// however many values the parts before it used
+	void start_dimension(uint32_t d) { dimension = d; }
+
+	uint32_t next_uint()
+	{
+		const uint32_t result = state[0] + state[3];
+		const uint32_t t = state[1] << 9;
+
+		state[2] ^= state[0];
+		state[3] ^= state[1];
+		state[1] ^= state[2];
+		state[0] ^= state[3];
+		state[2] ^= t;
+		state[3] = rotl(state[3], 11);
+
+		return result;
+	}
+
+	// uniform float in [0, 1)
+	float next_float()
+	{
+		switch(_sequence)
+		{
+		case SampleSequence::Sobol:
+			return to_float(sobol(dimension++));
+		case SampleSequence::Halton:
+			if(dimension < num_halton_dimensions) return halton(dimension++);
+			dimension++;
+			break;
+		case SampleSequence::Independent:
+			break;
+		}
+
+		return to_float(next_uint());
+	}
+
+private:
+	static constexpr uint32_t num_halton_dimensions = 32;
+
+	// direction numbers of the first four Sobol dimensions, from the primitive
+	// polynomials and initial direction numbers of Joe and Kuo (the first is
+	// the van der Corput sequence). Owen scrambling works on bit reversed
+	// numbers, so they are kept reversed and combined for every value of each
+	// byte of a reversed index; a point then takes four lookups.
+	struct SobolTables
+	{
+		uint32_t bytes[4][4][256];
+
+		SobolTables()
+		{
+			const uint32_t s[4] = {0, 1, 2, 3}, a[4] = {0, 0, 1, 1};
+			const uint32_t m[4][3] = {{1, 0, 0}, {1, 0, 0}, {1, 3, 0}, {1, 3, 1}};
+			for(int d = 0; d < 4; d++)
+			{
+				uint32_t v[32];
+				for(uint32_t i = 0; i < 32; i++)
+				{
+					if(d == 0 || i < s[d])
+					{
+						v[i] = (d == 0 ? 1u : m[d][i]) << (31 - i);
+						continue;
+					}
+
+					v[i] = v[i - s[d]] ^ (v[i - s[d]] >> s[d]);
+					for(uint32_t k = 1; k < s[d]; k++)
+						v[i] ^= ((a[d] >> (s[d] - 1 - k)) & 1) * v[i - k];
+				}
+
+				for(int byte = 0; byte < 4; byte++)
+				{
+					for(uint32_t value = 0; value < 256; value++)
+					{
+						uint32_t x = 0;
+						for(int bit = 0; bit < 8; bit++)
+							if(value & (1u << bit)) x ^= reverse_bits(v[31 - 8 * byte - bit]);
+						bytes[d][byte][value] = x;
+					}
+				}
+			}
+		}
+	};
+
+	static inline const SobolTables sobol_tables;
+
+	static float to_float(uint32_t x) { return static_cast<float>(x >> 8) * (1.f / 16777216.f); }
+
+	uint32_t sobol(uint32_t d)
+	{
+		// the four dimensions of a group share the shuffled index
+		if(d / 4 != group)
+		{
+			group = d / 4;
+			const uint32_t group_seed = hash(pixel_seed ^ hash(group + 0x5bd1e995u));
+			group_index = owen_scramble(reversed_index, group_seed);
+		}
+
+		// the index's bits pick which direction numbers to combine, a byte at a time
+		const uint32_t(&bytes)[4][256] = sobol_tables.bytes[d % 4];
+		const uint32_t x = bytes[0][group_index & 0xff] ^ bytes[1][(group_index >> 8) & 0xff] ^
+						   bytes[2][(group_index >> 16) & 0xff] ^ bytes[3][group_index >> 24];
+
+		return reverse_bits(owen_scramble(x, hash(pixel_seed ^ d)));
+	}
+
+	float halton(uint32_t d) const
+	{
+		static constexpr uint32_t primes[num_halton_dimensions] = {
+			2,  3,  5,  7,  11, 13, 17, 19, 23, 29, 31, 37, 41, 43,  47,  53,
+			59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131};
+
+		// every digit is permuted by a permutation depending on the digits
+		// before it, a different one for each stratum. Past the index's last
+		// digit that leaves a uniformly random point in the final stratum.
+		const uint32_t base = primes[d];
+		const uint32_t seed = hash(pixel_seed ^ d);
+		const double inv_base = 1.0 / base;
+		double inv_base_n = 1.0, result = 0.0;
+		uint32_t prefix = 0;
+		for(uint32_t a = sample_index; a; a /= base)
+		{
+			const uint32_t digit = permute(a % base, base, hash(seed ^ prefix));
+			inv_base_n *= inv_base;
+			result += digit * inv_base_n;
+			prefix = prefix * base + digit + 1;
+		}
+		result += (hash(seed ^ prefix) >> 8) * (1.0 / 16777216.0) * inv_base_n;
+
+		return result < 1.0 ? static_cast<float>(result) : 0x1.fffffep-1f;
+	}
+
+	// Owen scrambling of a bit reversed 32 bit fixed point number: flipping
+	// each bit depending on all the bits above it, which after the reversal
+	// are below it, where a multiply can carry them
+	static uint32_t owen_scramble(uint32_t x, uint32_t seed)
+	{
+		x ^= x * 0x3d20adeau;
+		x += seed;
+		x *= (seed >> 16) | 1;
+		x ^= x * 0x05526c56u;
+		x ^= x * 0x53a22864u;
+		return x;
+	}
+
+	// element i of a random permutation of 0 .. n - 1 (Kensler, "Correlated
+	// Multi-Jittered Sampling", 2013)
+	static uint32_t permute(uint32_t i, uint32_t n, uint32_t seed)
+	{
+		uint32_t w = n - 1;
+		w |= w >> 1;
+		w |= w >> 2;
+		w |= w >> 4;
+		w |= w >> 8;
+		w |= w >> 16;
+		do
+		{
+			i ^= seed;
+			i *= 0xe170893du;
+			i ^= seed >> 16;
+			i ^= (i & w) >> 4;
+			i ^= seed >> 8;
+			i *= 0x0929eb3fu;
+			i ^= seed >> 23;
+			i ^= (i & w) >> 1;
+			i *= 1 | seed >> 27;
+			i *= 0x6935fa69u;
+			i ^= (i & w) >> 11;
+			i *= 0x74dcb303u;
+			i ^= (i & w) >> 2;
+			i *= 0x9e501cc3u;
+			i ^= (i & w) >> 2;
+			i *= 0xc860a3dfu;
+			i &= w;
+			i ^= i >> 5;
+		} while(i >= n);
+
+		return (i + seed) % n;
+	}
+
+	static uint32_t reverse_bits(uint32_t x)
+	{
+		x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+		x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+		x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+		x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+		return (x >> 16) | (x << 16);
+	}
+
+	static uint32_t hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	static uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+	static uint64_t splitmix64(uint64_t& x)
+	{
+		uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+private:
+	uint32_t state[4];
+	SampleSequence _sequence = SampleSequence::Independent;
+	uint32_t _seed = 0;
+	uint32_t pixel_seed = 0;
+	uint32_t sample_index = 0;
+	uint32_t dimension = 0;
+
+	// the Sobol index of the current group of four dimensions
+	uint32_t reversed_index = 0;
+	uint32_t group = ~0u;
+	uint32_t group_index = 0;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "camera.h"
+#include "hittable.h"
+#include "material_registry.h"
+
+#include <memory>
+
+/*
+ *  Everything the renderer needs to know about a scene: the objects to
+ *  intersect and, separately, the emitting objects that should be sampled
+ *  directly. Lights are also part of the world, lights may be null. The
+ *  materials the objects refer to are owned here, and the scene suggests a
+ *  camera to view it with.
+ */
+
+struct Scene
+{
+	std::shared_ptr<Hittable> world;
+	std::shared_ptr<Hittable> lights;
+	MaterialRegistry materials;
+	CameraSettings camera;
+};
@@ -1,56 +1,80 @@
 #pragma once
 
+#include "bounds_check.h"
 #include "box.h"
-#include "bvh_node.h"
 #include "flip_normals.h"
 #include "hittable.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
 #include "material.h"
+#include "material_registry.h"
 #include "moving_sphere.h"
 #include "perlin.h"
 #include "rect.h"
 #include "rotate.h"
+#include "scene.h"
 #include "sphere.h"
 #include "texture.h"
+#include "top_level_bvh.h"
+#include "transform.h"
 #include "translate.h"
 
+#include <algorithm>
 #include <memory>
+#include <random>
+#include <string>
+#include <utility>
 #include <vector>
 
 class SceneFactory
 {
 public:
-	static std::shared_ptr<Hittable> test_scene()
+	static Scene test_scene()
 	{
+		MaterialRegistry materials;
 		constexpr int list_size = 5;
 		hittables_vec list(list_size);
-		auto t0 = std::make_shared<ConstantTexture>(vec3(0.1f, 0.2f, 0.5f));
-		auto t1 = std::make_shared<ConstantTexture>(vec3(0.8f, 0.8f, 0.f));
+		auto t0 = materials.add_texture(ConstantTexture(vec3(0.1f, 0.2f, 0.5f)));
+		auto t1 = materials.add_texture(ConstantTexture(vec3(0.8f, 0.8f, 0.f)));
 
-		list[0] =
-			std::make_shared<Sphere>(vec3(0.f, 0.f, -1.f), 0.5f, std::make_shared<Lambertian>(t0));
+		list[0] = std::make_shared<Sphere>(
+			vec3(0.f, 0.f, -1.f), 0.5f, materials.emplace<Lambertian>(t0));
 		list[1] = std::make_shared<Sphere>(
-			vec3(0.f, -100.5f, -1.f), 100.f, std::make_shared<Lambertian>(t1));
+			vec3(0.f, -100.5f, -1.f), 100.f, materials.emplace<Lambertian>(t1));
 		list[2] = std::make_shared<Sphere>(
-			vec3(1.f, 0.f, -1.f), 0.5f, std::make_shared<Metal>(vec3(0.8f, 0.6f, 0.2f), 0.3f));
+			vec3(1.f, 0.f, -1.f), 0.5f, materials.emplace<Metal>(vec3(0.8f, 0.6f, 0.2f), 0.3f));
 		list[3] = std::make_shared<Sphere>(
-			vec3(-1.f, 0.f, -1.f), 0.5f, std::make_shared<Dielectric>(1.5f));
+			vec3(-1.f, 0.f, -1.f), 0.5f, materials.emplace<Dielectric>(1.5f));
 		list[4] = std::make_shared<Sphere>(
-			vec3(-1.f, 0.f, -1.f), -0.45f, std::make_shared<Dielectric>(1.5f));
+			vec3(-1.f, 0.f, -1.f), -0.45f, materials.emplace<Dielectric>(1.5f));
 
-		return std::make_shared<BVHNode>(list, 0.f, 1.f);
+		return {make_world(list),
+				nullptr,
+				std::move(materials),
+				view(vec3(-2.f, 2.f, 1.f), vec3(0.f, 0.f, -1.f), 40.f)};
 	}
 
-	static std::shared_ptr<Hittable> random_scene()
+	static Scene random_scene()
+	{
+		MaterialRegistry materials;
+		hittables_vec hittables = random_scene_objects(materials);
+		CameraSettings camera = view(vec3(13.f, 2.f, 3.f), vec3(0.f, 0.f, 0.f), 20.f);
+		camera.aperture = 0.1f;
+		return {make_world(hittables), nullptr, std::move(materials), camera};
+	}
+
+	// the objects making up random_scene(), so they can be put in any structure
+	static hittables_vec random_scene_objects(MaterialRegistry& materials)
 	{
 		constexpr int num_spheres = 11;
 		hittables_vec hittables;
 		hittables.reserve((2 * num_spheres) * (2 * num_spheres + 4));
 
-		auto checker_tex = std::make_shared<CheckerTexture>(
-			std::make_shared<ConstantTexture>(vec3(0.2f, 0.3f, 0.1f)),
-			std::make_shared<ConstantTexture>(vec3(0.9f, 0.9f, 0.9f)));
+		auto checker_tex = materials.add_texture(
+			CheckerTexture(materials.add_texture(ConstantTexture(vec3(0.2f, 0.3f, 0.1f))),
+						   materials.add_texture(ConstantTexture(vec3(0.9f, 0.9f, 0.9f)))));
 		hittables.emplace_back(std::make_shared<Sphere>(
-			vec3(0, -1000.f, 0.f), 1000.f, std::make_shared<Lambertian>(checker_tex)));
+			vec3(0, -1000.f, 0.f), 1000.f, materials.emplace<Lambertian>(checker_tex)));
 
 		std::mt19937 mt_engine(std::random_device{}());
 		std::uniform_real_distribution<float> fdist(0.f, 0.999f);
@@ -65,24 +89,24 @@ public:
 				{
 					if(choose_mat < 0.8f) // diffuse
 					{
-						auto tex = std::make_shared<ConstantTexture>(
+						auto tex = materials.add_texture(ConstantTexture(
 							vec3(fdist(mt_engine) * fdist(mt_engine),
 								 fdist(mt_engine) * fdist(mt_engine),
-								 fdist(mt_engine) * fdist(mt_engine)));
+								 fdist(mt_engine) * fdist(mt_engine))));
 						hittables.emplace_back(std::make_shared<MovingSphere>(
 							centre,
 							centre + vec3(0.f, 0.5f * fdist(mt_engine), 0.f),
 							0.f,
 							1.f,
 							0.2f,
-							std::make_shared<Lambertian>(tex)));
+							materials.emplace<Lambertian>(tex)));
 					}
 					else if(choose_mat < 0.95f) // metal
 					{
 						hittables.emplace_back(std::make_shared<Sphere>(
 							centre,
 							0.2f,
-							std::make_shared<Metal>(vec3(0.5f * (1.f + fdist(mt_engine)),
+							materials.emplace<Metal>(vec3(0.5f * (1.f + fdist(mt_engine)),
 														 0.5f * (1.f + fdist(mt_engine)),
 														 0.5f * (1.f + fdist(mt_engine))),
 													0.5f * fdist(mt_engine))));
@@ -90,109 +114,121 @@ public:
 					else // glass
 					{
 						hittables.emplace_back(std::make_shared<Sphere>(
-							centre, 0.2f, std::make_shared<Dielectric>(1.5f)));
+							centre, 0.2f, materials.emplace<Dielectric>(1.5f)));
 					}
 				}
 			}
 		}
 
-		hittables.emplace_back(
-			std::make_shared<Sphere>(vec3(0.f, 1.f, 0.f), 1.f, std::make_shared<Dielectric>(1.5f)));
+		hittables.emplace_back(std::make_shared<Sphere>(
+			vec3(0.f, 1.f, 0.f), 1.f, materials.emplace<Dielectric>(1.5f)));
 
-		auto tex = std::make_shared<ConstantTexture>(vec3(0.4f, 0.2f, 0.1f));
-		hittables.emplace_back(
-			std::make_shared<Sphere>(vec3(-4.f, 1.f, 0.f), 1.f, std::make_shared<Lambertian>(tex)));
+		auto tex = materials.add_texture(ConstantTexture(vec3(0.4f, 0.2f, 0.1f)));
+		hittables.emplace_back(std::make_shared<Sphere>(
+			vec3(-4.f, 1.f, 0.f), 1.f, materials.emplace<Lambertian>(tex)));
 
 		hittables.emplace_back(std::make_shared<Sphere>(
-			vec3(4.f, 1.f, 0.f), 1.f, std::make_shared<Metal>(vec3(0.7f, 0.6f, 0.5f), 0.f)));
+			vec3(4.f, 1.f, 0.f), 1.f, materials.emplace<Metal>(vec3(0.7f, 0.6f, 0.5f), 0.f)));
 
-		return std::make_shared<HittableList>(hittables, static_cast<int>(hittables.size()));
+		return hittables;
 	}
 
-	static std::shared_ptr<Hittable> two_spheres()
+	static Scene two_spheres()
 	{
+		MaterialRegistry materials;
 		constexpr size_t num_spheres = 50;
 		hittables_vec list;
 		list.reserve(num_spheres + 1);
 
-		auto checker_tex = std::make_shared<CheckerTexture>(
-			std::make_shared<ConstantTexture>(vec3(0.2f, 0.3f, 0.1f)),
-			std::make_shared<ConstantTexture>(vec3(0.9f, 0.9f, 0.9f)));
+		auto checker_tex = materials.add_texture(
+			CheckerTexture(materials.add_texture(ConstantTexture(vec3(0.2f, 0.3f, 0.1f))),
+						   materials.add_texture(ConstantTexture(vec3(0.9f, 0.9f, 0.9f)))));
 
 		list.emplace_back(std::make_shared<Sphere>(
-			vec3(0.f, -10.f, 0.f), 10.f, std::make_shared<Lambertian>(checker_tex)));
+			vec3(0.f, -10.f, 0.f), 10.f, materials.emplace<Lambertian>(checker_tex)));
 		list.emplace_back(std::make_shared<Sphere>(
-			vec3(0.f, 10.f, 0.f), 10.f, std::make_shared<Lambertian>(checker_tex)));
+			vec3(0.f, 10.f, 0.f), 10.f, materials.emplace<Lambertian>(checker_tex)));
 
-		return std::make_shared<HittableList>(list, static_cast<int>(list.size()));
+		return {make_world(list),
+				nullptr,
+				std::move(materials),
+				view(vec3(13.f, 2.f, 3.f), vec3(0.f, 0.f, 0.f), 20.f)};
 	}
 
-	static std::shared_ptr<Hittable> two_perlin_spheres()
+	static Scene two_perlin_spheres()
 	{
-		auto perlin_tex = std::make_shared<NoiseTexture>(4.f);
+		MaterialRegistry materials;
+		auto perlin_tex = materials.add_texture(NoiseTexture(4.f));
 		hittables_vec list;
 
 		list.emplace_back(std::make_shared<Sphere>(
-			vec3(0.f, -1000.f, 0.f), 1000.f, std::make_shared<Lambertian>(perlin_tex)));
+			vec3(0.f, -1000.f, 0.f), 1000.f, materials.emplace<Lambertian>(perlin_tex)));
 		list.emplace_back(std::make_shared<Sphere>(
-			vec3(0.f, 2.f, 0.f), 2.f, std::make_shared<Lambertian>(perlin_tex)));
+			vec3(0.f, 2.f, 0.f), 2.f, materials.emplace<Lambertian>(perlin_tex)));
 
-		return std::make_shared<HittableList>(list, static_cast<int>(list.size()));
+		return {make_world(list),
+				nullptr,
+				std::move(materials),
+				view(vec3(13.f, 2.f, 3.f), vec3(0.f, 0.f, 0.f), 20.f)};
 	}
 
-	static std::shared_ptr<Hittable> two_image_spheres()
+	static Scene two_image_spheres()
 	{
-		auto mat = std::make_shared<Lambertian>(std::make_shared<ImageTexture>("world_map.jpg"));
+		MaterialRegistry materials;
+		auto world_map = materials.add_texture(ImageTexture("world_map.jpg"));
+		auto mat = materials.emplace<Lambertian>(world_map);
 		hittables_vec list;
 
 		list.emplace_back(std::make_shared<Sphere>(vec3(0.f, 0.f, 0.f), 2.f, mat));
 
-		return std::make_shared<HittableList>(list, static_cast<int>(list.size()));
+		return {make_world(list),
+				nullptr,
+				std::move(materials),
+				view(vec3(13.f, 2.f, 3.f), vec3(0.f, 0.f, 0.f), 20.f)};
 	}
 
-	static std::shared_ptr<Hittable> simple_light()
+	static Scene simple_light()
 	{
-		auto perlin_tex = std::make_shared<NoiseTexture>(4.f);
+		MaterialRegistry materials;
+		auto perlin_tex = materials.add_texture(NoiseTexture(4.f));
 		hittables_vec list;
+		hittables_vec lights;
 
 		list.emplace_back(std::make_shared<Sphere>(
-			vec3(0.f, -1000.f, 0.f), 1000.f, std::make_shared<Lambertian>(perlin_tex)));
+			vec3(0.f, -1000.f, 0.f), 1000.f, materials.emplace<Lambertian>(perlin_tex)));
 		list.emplace_back(std::make_shared<Sphere>(
-			vec3(0.f, 2.f, 0.f), 2.f, std::make_shared<Lambertian>(perlin_tex)));
-		list.emplace_back(
-			std::make_shared<Sphere>(vec3(0.f, 7.f, 0.f),
-									 2.f,
-									 std::make_shared<DiffuseLight>(
-										 std::make_shared<ConstantTexture>(vec3(4.f, 4.f, 4.f)))));
-		list.emplace_back(
-			std::make_shared<XYRect>(3.f,
-									 5.f,
-									 1.f,
-									 3.f,
-									 -2.f,
-									 std::make_shared<DiffuseLight>(
-										 std::make_shared<ConstantTexture>(vec3(4.f, 4.f, 4.f)))));
-
-		return std::make_shared<HittableList>(list, static_cast<int>(list.size()));
+			vec3(0.f, 2.f, 0.f), 2.f, materials.emplace<Lambertian>(perlin_tex)));
+		auto light = materials.emplace<DiffuseLight>(
+			materials.add_texture(ConstantTexture(vec3(4.f, 4.f, 4.f))));
+		lights.emplace_back(std::make_shared<Sphere>(vec3(0.f, 7.f, 0.f), 2.f, light));
+		lights.emplace_back(std::make_shared<XYRect>(3.f, 5.f, 1.f, 3.f, -2.f, light));
+		list.insert(list.end(), lights.begin(), lights.end());
+
+		return {make_world(list),
+				std::make_shared<HittableList>(lights, static_cast<int>(lights.size())),
+				std::move(materials),
+				view(vec3(26.f, 3.f, 6.f), vec3(0.f, 2.f, 0.f), 20.f)};
 	}
 
-	static std::shared_ptr<Hittable> cornell_box()
+	static Scene cornell_box()
 	{
+		MaterialRegistry materials;
 		hittables_vec list;
 
-		auto red = std::make_shared<Lambertian>(
-			std::make_shared<ConstantTexture>(vec3(0.65f, 0.05f, 0.05f)));
-		auto white = std::make_shared<Lambertian>(
-			std::make_shared<ConstantTexture>(vec3(0.73f, 0.73f, 0.73f)));
-		auto green = std::make_shared<Lambertian>(
-			std::make_shared<ConstantTexture>(vec3(0.12f, 0.45f, 0.15f)));
-		auto light = std::make_shared<DiffuseLight>(
-			std::make_shared<ConstantTexture>(vec3(15.f, 15.f, 15.f)));
+		auto red = materials.emplace<Lambertian>(
+			materials.add_texture(ConstantTexture(vec3(0.65f, 0.05f, 0.05f))));
+		auto white = materials.emplace<Lambertian>(
+			materials.add_texture(ConstantTexture(vec3(0.73f, 0.73f, 0.73f))));
+		auto green = materials.emplace<Lambertian>(
+			materials.add_texture(ConstantTexture(vec3(0.12f, 0.45f, 0.15f))));
+		auto light = materials.emplace<DiffuseLight>(
+			materials.add_texture(ConstantTexture(vec3(15.f, 15.f, 15.f))));
 
 		list.emplace_back(std::make_shared<FlipNormals>(
 			std::make_shared<YZRect>(0.f, 555.f, 0.f, 555.f, 555.f, green)));
 		list.emplace_back(std::make_shared<YZRect>(0.f, 555.f, 0.f, 555.f, 0.f, red));
-		list.emplace_back(std::make_shared<XZRect>(213.f, 343.f, 227.f, 332.f, 554.f, light));
+		auto light_rect = std::make_shared<XZRect>(213.f, 343.f, 227.f, 332.f, 554.f, light);
+		list.emplace_back(light_rect);
 		list.emplace_back(std::make_shared<FlipNormals>(
 			std::make_shared<XZRect>(0.f, 555.f, 0.f, 555.f, 555.f, white)));
 		list.emplace_back(std::make_shared<XZRect>(0.f, 555.f, 0.f, 555.f, 0.f, white));
@@ -210,6 +246,120 @@ public:
                 std::make_shared<Box>(vec3(0.f, 0.f, 0.f), vec3(165.f, 330.f, 165.f), white), 15.f),
             vec3(265.f, 0.f, 295.f)));
 
-        return std::make_shared<HittableList>(list, static_cast<int>(list.size()));
+		for(auto& object : list) object = fold_transforms(object);
+
+		return {make_world(list),
+				std::make_shared<HittableList>(hittables_vec{light_rect}, 1),
+				std::move(materials),
+				view(vec3(278.f, 278.f, -800.f), vec3(278.f, 278.f, 0.f), 40.f)};
+	}
+
+	// a grid of boxes, all instances of one of a few shared boxes
+	static Scene box_field()
+	{
+		constexpr int grid_size = 100;
+		constexpr float spacing = 1.5f;
+		MaterialRegistry materials;
+		hittables_vec list;
+
+		const vec3 colours[] = {vec3(0.73f, 0.73f, 0.73f),
+								vec3(0.65f, 0.05f, 0.05f),
+								vec3(0.12f, 0.45f, 0.15f),
+								vec3(0.1f, 0.2f, 0.5f)};
+		hittables_vec boxes;
+		for(const vec3& colour : colours)
+		{
+			auto texture = materials.add_texture(ConstantTexture(colour));
+			auto mat = materials.emplace<Lambertian>(texture);
+			boxes.emplace_back(
+				std::make_shared<Box>(vec3(-0.5f, 0.f, -0.5f), vec3(0.5f, 1.f, 0.5f), mat));
+		}
+
+		std::mt19937 mt_engine(std::random_device{}());
+		std::uniform_real_distribution<float> fdist(0.f, 1.f);
+
+		std::vector<Instance> instances;
+		instances.reserve(grid_size * grid_size);
+		const float half = 0.5f * spacing * (grid_size - 1);
+		for(int i = 0; i < grid_size; i++)
+		{
+			for(int j = 0; j < grid_size; j++)
+			{
+				const auto which = std::min(static_cast<size_t>(fdist(mt_engine) * boxes.size()),
+											boxes.size() - 1);
+				const vec3 position(i * spacing - half, 0.f, j * spacing - half);
+				const float height = 0.5f + 2.5f * fdist(mt_engine) * fdist(mt_engine);
+				instances.push_back({boxes[which],
+									 Affine::translation(position) *
+										 Affine::rotation_y(90.f * fdist(mt_engine)) *
+										 Affine::scaling(vec3(1.f, height, 1.f))});
+			}
+		}
+		list.emplace_back(std::make_shared<TopLevelBVH>(instances, 0.f, 1.f));
+
+		auto ground = materials.emplace<Lambertian>(
+			materials.add_texture(ConstantTexture(vec3(0.48f, 0.83f, 0.53f))));
+		list.emplace_back(std::make_shared<XZRect>(-100.f, 100.f, -100.f, 100.f, 0.f, ground));
+
+		auto light = materials.emplace<DiffuseLight>(
+			materials.add_texture(ConstantTexture(vec3(7.f, 7.f, 7.f))));
+		auto light_rect = std::make_shared<XZRect>(-40.f, 40.f, -40.f, 40.f, 60.f, light);
+		list.emplace_back(light_rect);
+
+		return {make_world(list),
+				std::make_shared<HittableList>(hittables_vec{light_rect}, 1),
+				std::move(materials),
+				view(vec3(0.f, 30.f, 90.f), vec3(0.f, 0.f, 0.f), 40.f)};
+	}
+
+	using Builder = Scene (*)();
+
+	// the scenes above which can be picked by name, e.g. on the command line
+	static const std::vector<std::pair<const char*, Builder>>& scenes()
+	{
+		static const std::vector<std::pair<const char*, Builder>> table = {
+			{"test_scene", test_scene},
+			{"random_scene", random_scene},
+			{"two_spheres", two_spheres},
+			{"two_perlin_spheres", two_perlin_spheres},
+			{"two_image_spheres", two_image_spheres},
+			{"simple_light", simple_light},
+			{"cornell_box", cornell_box},
+			{"box_field", box_field}};
+		return table;
+	}
+
+	// null if there is no scene called name
+	static Builder find(const std::string& name)
+	{
+		for(const auto& scene : scenes())
+			if(name == scene.first) return scene.second;
+		return nullptr;
+	}
+
+	// puts the objects in a BVH or, to validate their bounding boxes, in a
+	// list where each of them checks its hits against its box
+	static std::shared_ptr<Hittable> make_world(const hittables_vec& objects,
+												BVHSource* source = nullptr)
+	{
+#ifdef RAYTRACER_VALIDATE_BOUNDS
+		static_cast<void>(source);
+		hittables_vec checked;
+		for(const auto& object : objects)
+			checked.emplace_back(std::make_shared<BoundsCheck>(object, 0.f, 1.f));
+		return std::make_shared<HittableList>(checked, static_cast<int>(checked.size()));
+#else
+		return std::make_shared<LinearBVHList>(objects, 0.f, 1.f, BVHSplit::SAH, source);
+#endif
+	}
+
+private:
+	static CameraSettings view(const vec3& lookfrom, const vec3& lookat, float vfov)
+	{
+		CameraSettings camera;
+		camera.lookfrom = lookfrom;
+		camera.lookat = lookat;
+		camera.vfov = vfov;
+		return camera;
 	}
 };
@@ -0,0 +1,725 @@
+#pragma once
+
+#include "affine.h"
+#include "box.h"
+#include "bvh_cache.h"
+#include "camera.h"
+#include "flip_normals.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+#include "mapped_file.h"
+#include "material.h"
+#include "material_registry.h"
+#include "mesh_loader.h"
+#include "moving_sphere.h"
+#include "rect.h"
+#include "scene.h"
+#include "scene_factory.h"
+#include "sphere.h"
+#include "texture.h"
+#include "top_level_bvh.h"
+#include "transform.h"
+#include "triangle_mesh.h"
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+/*
+ *  Loads a scene from a text file with one command per line; # starts a
+ *  comment. Textures, materials and object definitions are named and
+ *  referred to by name after they are defined. Relative paths of images and
+ *  meshes are relative to the scene file.
+ *
+ *    camera lookfrom x y z lookat x y z [vup x y z] [vfov degrees]
+ *           [aperture a] [focus distance] [time t0 t1]
+ *
+ *    texture <name> constant r g b | checker <odd> <even> | noise <scale>
+ *                   | image <path>
+ *    material <name> lambertian <albedo> | metal r g b <fuzz>
+ *                    | dielectric <refractive index> | light <emission>
+ *
+ *  where a texture argument is either a texture's name or a colour r g b.
+ *
+ *    sphere x y z <radius> <material>
+ *    moving_sphere x0 y0 z0 x1 y1 z1 <t0> <t1> <radius> <material>
+ *    xy_rect x0 x1 y0 y1 <z> <material>   (xz_rect and yz_rect alike)
+ *    box x0 y0 z0 x1 y1 z1 <material>
+ *    mesh <path> <material>               (PLY or OBJ)
+ *
+ *  Shapes are placed with the current transform, which starts as the
+ *  identity and is changed by
+ *
+ *    translate x y z | rotate <axis x y z> <degrees> | scale x y z
+ *    flip                                 (turns normals inside out)
+ *    push | pop                           (saves and restores it)
+ *
+ *  each applied to shapes before the transform so far. Geometry used many
+ *  times is defined once between "object <name>" and "end", starting from
+ *  the identity, and placed with "instance <name>"; the instances go in a
+ *  TopLevelBVH. Spheres and rects with a light material are sampled as
+ *  lights.
+ *
+ *  The file is memory mapped and parsed in one pass with no allocation per
+ *  token, so files with millions of shapes load about as fast as the
+ *  shapes can be made. Given a cache directory, the BVHs built for the
+ *  scene are kept in a BVHCache there named after a hash of the file's
+ *  contents, and loading the same file again maps them in rather than
+ *  building them. On failure load() prints the line at fault and returns
+ *  false.
+ */
+
+class SceneLoader
+{
+public:
+	struct Stats
+	{
+		size_t bytes = 0;
+		size_t lines = 0;
+		size_t objects = 0;
+		double parse_seconds = 0.0; // reading the file and making the shapes
+		double build_seconds = 0.0; // the BVHs over them
+		size_t cached_bvhs = 0; // read from the cache rather than built
+		size_t built_bvhs = 0;
+
+		void print(std::ostream& os) const
+		{
+			const double mb = bytes / (1024.0 * 1024.0);
+			os << "Parsed " << lines << " lines (" << mb << " MB), " << objects << " objects in "
+			   << 1000.0 * parse_seconds << "ms (" << mb / parse_seconds << " MB/s), built in "
+			   << 1000.0 * build_seconds << "ms\n";
+			if(cached_bvhs + built_bvhs > 0)
+				os << "BVH cache: " << cached_bvhs << " BVHs read, " << built_bvhs << " built\n";
+		}
+	};
+
+	// cache_directory is where BVHs are cached, none if empty
+	static bool load(const std::string& path,
+					 Scene& scene,
+					 Stats* stats = nullptr,
+					 const std::string& cache_directory = std::string())
+	{
+		using clock = std::chrono::steady_clock;
+		const auto start = clock::now();
+
+		MappedFile file(path);
+		if(!file.is_open())
+		{
+			std::cerr << "Could not open " << path << "\n";
+			return false;
+		}
+
+		std::unique_ptr<BVHCache> cache;
+		if(!cache_directory.empty())
+			cache = std::make_unique<BVHCache>(cache_path(cache_directory, file));
+
+		// names are views into the file, so it has to stay mapped while parsing
+		Parser parser(path, cache.get());
+		const char* const end = file.data() + file.size();
+		for(const char* line = file.data(); line < end;)
+		{
+			const char* line_end = next_line(line, end);
+			if(!parser.parse_line(line, line_end)) return false;
+			line = line_end;
+		}
+		if(!parser.finish()) return false;
+
+		const auto parsed = clock::now();
+		scene = parser.build();
+		if(cache) cache->save();
+
+		if(stats)
+		{
+			stats->cached_bvhs = cache ? cache->hits() : 0;
+			stats->built_bvhs = cache ? cache->misses() : 0;
+			stats->bytes = file.size();
+			stats->lines = parser.num_lines;
+			stats->objects = parser.num_objects;
+			stats->parse_seconds = std::chrono::duration<double>(parsed - start).count();
+			stats->build_seconds = std::chrono::duration<double>(clock::now() - parsed).count();
+		}
+
+		return true;
+	}
+
+	// the BVH cache file load() uses for a scene file, empty if it can't be read
+	static std::string cache_path(const std::string& directory, const std::string& path)
+	{
+		MappedFile file(path);
+		return file.is_open() ? cache_path(directory, file) : std::string();
+	}
+
+private:
+	static std::string cache_path(const std::string& directory, const MappedFile& file)
+	{
+		char name[32];
+		std::snprintf(name,
+					  sizeof(name),
+					  "%016llx.bvh",
+					  static_cast<unsigned long long>(BVHCache::hash(file.data(), file.size())));
+
+		const char last = directory.back();
+		return directory + (last == '/' || last == '\\' ? "" : "/") + name;
+	}
+
+	static const char* next_line(const char* p, const char* end)
+	{
+		const void* newline = std::memchr(p, '\n', static_cast<size_t>(end - p));
+		return newline ? static_cast<const char*>(newline) + 1 : end;
+	}
+
+	class Parser
+	{
+	public:
+		Parser(const std::string& path, BVHSource* bvh_source)
+			: path(path)
+			, directory(path.substr(0, path.find_last_of("/\\") + 1))
+			, bvh_source(bvh_source)
+		{}
+
+		size_t num_lines = 0;
+		size_t num_objects = 0;
+
+		bool parse_line(const char* begin, const char* end)
+		{
+			num_lines++;
+			cur = begin;
+			line_end = end;
+
+			std::string_view command;
+			if(!word(command)) return true; // blank or a comment
+
+			bool ok = true;
+			if(command == "sphere")
+				ok = parse_sphere();
+			else if(command == "xy_rect" || command == "xz_rect" || command == "yz_rect")
+				ok = parse_rect(command[0], command[1]);
+			else if(command == "box")
+				ok = parse_box();
+			else if(command == "moving_sphere")
+				ok = parse_moving_sphere();
+			else if(command == "mesh")
+				ok = parse_mesh();
+			else if(command == "material")
+				ok = parse_material();
+			else if(command == "texture")
+				ok = parse_texture();
+			else if(command == "translate" || command == "rotate" || command == "scale")
+				ok = parse_transform(command);
+			else if(command == "flip")
+				state.flip = !state.flip;
+			else if(command == "push")
+				stack.push_back(state);
+			else if(command == "pop")
+				ok = pop();
+			else if(command == "object")
+				ok = begin_object();
+			else if(command == "end")
+				ok = end_object();
+			else if(command == "instance")
+				ok = parse_instance();
+			else if(command == "camera")
+				ok = parse_camera();
+			else
+				return error("unknown command '" + std::string(command) + "'");
+
+			if(ok && !at_end()) return error("unexpected '" + std::string(rest()) + "'");
+			return ok;
+		}
+
+		bool finish()
+		{
+			if(in_object) return error("object '" + std::string(object_name) + "' has no end");
+			if(!stack.empty()) return error("push without a pop");
+			if(!has_camera) return error("no camera");
+			return true;
+		}
+
+		Scene build()
+		{
+			if(!instances.empty())
+				list.emplace_back(std::make_shared<TopLevelBVH>(instances, 0.f, 1.f, bvh_source));
+
+			std::shared_ptr<Hittable> light_list;
+			if(!lights.empty())
+			{
+				light_list =
+					std::make_shared<HittableList>(lights, static_cast<int>(lights.size()));
+			}
+
+			return {SceneFactory::make_world(list, bvh_source),
+					light_list,
+					std::move(materials),
+					camera};
+		}
+
+	private:
+		// the transform shapes are placed with
+		struct State
+		{
+			Affine to_world;
+			bool moved = false;
+			bool flip = false;
+		};
+
+		bool error(const std::string& message) const
+		{
+			std::cerr << path << ":" << num_lines << ": " << message << "\n";
+			return false;
+		}
+
+		/*
+		 *  Tokens
+		 */
+
+		void skip_blanks()
+		{
+			while(cur < line_end && (*cur == ' ' || *cur == '\t' || *cur == '\r' || *cur == '\n'))
+				cur++;
+		}
+
+		bool at_end()
+		{
+			skip_blanks();
+			return cur == line_end || *cur == '#';
+		}
+
+		std::string_view rest()
+		{
+			const char* p = line_end;
+			while(p > cur && (p[-1] == '\n' || p[-1] == '\r')) p--;
+			return std::string_view(cur, static_cast<size_t>(p - cur));
+		}
+
+		bool word(std::string_view& w)
+		{
+			if(at_end()) return false;
+
+			const char* begin = cur;
+			while(cur < line_end && *cur != ' ' && *cur != '\t' && *cur != '\r' && *cur != '\n')
+				cur++;
+			w = std::string_view(begin, static_cast<size_t>(cur - begin));
+			return true;
+		}
+
+		bool name(std::string_view& w, const char* what)
+		{
+			return word(w) || error(std::string("expected a ") + what + " name");
+		}
+
+		bool number(float& x)
+		{
+			skip_blanks();
+			if(cur < line_end && *cur == '+') cur++;
+
+			// from_chars stops at the first character it can't use, so the
+			// number must also end where the token does
+			auto result = std::from_chars(cur, line_end, x);
+			const char* end = result.ptr;
+			if(result.ec != std::errc() ||
+			   (end < line_end && *end != ' ' && *end != '\t' && *end != '\r' && *end != '\n' &&
+				*end != '#'))
+				return error("expected a number");
+
+			cur = end;
+			return true;
+		}
+
+		bool numbers(float* x, int n)
+		{
+			for(int i = 0; i < n; i++)
+				if(!number(x[i])) return false;
+			return true;
+		}
+
+		bool vector(vec3& v)
+		{
+			float x[3];
+			if(!numbers(x, 3)) return false;
+
+			v = vec3(x[0], x[1], x[2]);
+			return true;
+		}
+
+		bool looking_at_number()
+		{
+			skip_blanks();
+			return cur < line_end && (std::strchr("0123456789+-.", *cur) != nullptr);
+		}
+
+		/*
+		 *  Textures and materials
+		 */
+
+		bool material(MaterialId& id)
+		{
+			std::string_view w;
+			if(!name(w, "material")) return false;
+
+			auto found = materials_by_name.find(w);
+			if(found == materials_by_name.end())
+				return error("unknown material '" + std::string(w) + "'");
+
+			id = found->second;
+			return true;
+		}
+
+		// a texture's name, or a colour which becomes a constant texture
+		bool texture(TextureId& id)
+		{
+			if(looking_at_number())
+			{
+				vec3 colour;
+				if(!vector(colour)) return false;
+
+				id = materials.add_texture(ConstantTexture(colour));
+				return true;
+			}
+
+			std::string_view w;
+			if(!name(w, "texture")) return false;
+
+			auto found = textures.find(w);
+			if(found == textures.end()) return error("unknown texture '" + std::string(w) + "'");
+
+			id = found->second;
+			return true;
+		}
+
+		bool parse_texture()
+		{
+			std::string_view texture_name, type;
+			if(!name(texture_name, "texture") || !name(type, "texture type")) return false;
+			if(textures.count(texture_name))
+				return error("texture '" + std::string(texture_name) + "' is already defined");
+
+			TextureId id;
+			if(type == "constant")
+			{
+				vec3 colour;
+				if(!vector(colour)) return false;
+				id = materials.add_texture(ConstantTexture(colour));
+			}
+			else if(type == "checker")
+			{
+				TextureId odd, even;
+				if(!texture(odd) || !texture(even)) return false;
+				id = materials.add_texture(CheckerTexture(even, odd));
+			}
+			else if(type == "noise")
+			{
+				float scale;
+				if(!number(scale)) return false;
+				id = materials.add_texture(NoiseTexture(scale));
+			}
+			else if(type == "image")
+			{
+				std::string_view file;
+				if(!name(file, "image file")) return false;
+				id = materials.add_texture(ImageTexture(resolve(file)));
+			}
+			else
+				return error("unknown texture type '" + std::string(type) + "'");
+
+			textures.emplace(texture_name, id);
+			return true;
+		}
+
+		bool parse_material()
+		{
+			std::string_view material_name, type;
+			if(!name(material_name, "material") || !name(type, "material type")) return false;
+			if(materials_by_name.count(material_name))
+				return error("material '" + std::string(material_name) + "' is already defined");
+
+			MaterialId id;
+			if(type == "lambertian" || type == "light")
+			{
+				TextureId tex;
+				if(!texture(tex)) return false;
+				id = type == "light" ? materials.emplace<DiffuseLight>(tex)
+									 : materials.emplace<Lambertian>(tex);
+			}
+			else if(type == "metal")
+			{
+				vec3 albedo;
+				float fuzz;
+				if(!vector(albedo) || !number(fuzz)) return false;
+				id = materials.emplace<Metal>(albedo, fuzz);
+			}
+			else if(type == "dielectric")
+			{
+				float ref_idx;
+				if(!number(ref_idx)) return false;
+				id = materials.emplace<Dielectric>(ref_idx);
+			}
+			else
+				return error("unknown material type '" + std::string(type) + "'");
+
+			materials_by_name.emplace(material_name, id);
+			return true;
+		}
+
+		/*
+		 *  Shapes
+		 */
+
+		bool parse_sphere()
+		{
+			vec3 centre;
+			float radius;
+			MaterialId mat;
+			if(!vector(centre) || !number(radius) || !material(mat)) return false;
+
+			add(std::make_shared<Sphere>(centre, radius, mat), mat, true);
+			return true;
+		}
+
+		bool parse_moving_sphere()
+		{
+			vec3 centre0, centre1;
+			float x[3];
+			MaterialId mat;
+			if(!vector(centre0) || !vector(centre1) || !numbers(x, 3) || !material(mat))
+				return false;
+
+			add(std::make_shared<MovingSphere>(centre0, centre1, x[0], x[1], x[2], mat),
+				mat,
+				false);
+			return true;
+		}
+
+		// the plane is given by the two axes in its name, e.g. x and z for xz_rect
+		bool parse_rect(char a, char b)
+		{
+			float x[5];
+			MaterialId mat;
+			if(!numbers(x, 5) || !material(mat)) return false;
+
+			std::shared_ptr<Hittable> rect;
+			if(a == 'x' && b == 'y')
+				rect = std::make_shared<XYRect>(x[0], x[1], x[2], x[3], x[4], mat);
+			else if(a == 'x')
+				rect = std::make_shared<XZRect>(x[0], x[1], x[2], x[3], x[4], mat);
+			else
+				rect = std::make_shared<YZRect>(x[0], x[1], x[2], x[3], x[4], mat);
+
+			add(std::move(rect), mat, true);
+			return true;
+		}
+
+		bool parse_box()
+		{
+			vec3 p0, p1;
+			MaterialId mat;
+			if(!vector(p0) || !vector(p1) || !material(mat)) return false;
+
+			add(std::make_shared<Box>(p0, p1, mat), mat, false);
+			return true;
+		}
+
+		bool parse_mesh()
+		{
+			std::string_view file;
+			MaterialId mat;
+			if(!name(file, "mesh file") || !material(mat)) return false;
+
+			auto data = MeshLoader::load(resolve(file));
+			if(!data) return error("could not load mesh '" + std::string(file) + "'");
+			if(data->num_triangles() == 0)
+				return error("mesh '" + std::string(file) + "' has no triangles");
+
+			auto mesh =
+				std::make_shared<TriangleMesh>(std::move(data), mat, BVHSplit::SAH, bvh_source);
+			add(mesh, mat, false);
+			return true;
+		}
+
+		// places a shape with the current transform; sampled says whether
+		// the shape can be sampled as a light if it emits
+		void add(std::shared_ptr<Hittable> object, MaterialId mat, bool sampled)
+		{
+			if(state.moved)
+				object = std::make_shared<Transform>(std::move(object), state.to_world, state.flip);
+			else if(state.flip)
+				object = std::make_shared<FlipNormals>(std::move(object));
+
+			num_objects++;
+			if(in_object)
+			{
+				object_list.push_back(std::move(object));
+				return;
+			}
+
+			if(sampled && std::holds_alternative<DiffuseLight>(materials[mat]))
+				lights.push_back(object);
+			list.push_back(std::move(object));
+		}
+
+		/*
+		 *  Transforms and instances
+		 */
+
+		bool parse_transform(std::string_view command)
+		{
+			vec3 v;
+			if(!vector(v)) return false;
+
+			Affine a;
+			if(command == "translate")
+				a = Affine::translation(v);
+			else if(command == "scale")
+			{
+				if(v.x() == 0.f || v.y() == 0.f || v.z() == 0.f) return error("scale by zero");
+				a = Affine::scaling(v);
+			}
+			else
+			{
+				float degrees;
+				if(!number(degrees)) return false;
+				if(v.squared_length() == 0.f) return error("rotation about a zero axis");
+				a = Affine::rotation(v, degrees);
+			}
+
+			state.to_world = state.to_world * a;
+			state.moved = true;
+			return true;
+		}
+
+		bool pop()
+		{
+			if(stack.empty()) return error("pop without a push");
+
+			state = stack.back();
+			stack.pop_back();
+			return true;
+		}
+
+		bool begin_object()
+		{
+			if(in_object) return error("objects can't be nested");
+			if(!name(object_name, "object")) return false;
+			if(objects.count(object_name))
+				return error("object '" + std::string(object_name) + "' is already defined");
+
+			in_object = true;
+			object_stack_size = stack.size();
+			stack.push_back(state);
+			state = State();
+			return true;
+		}
+
+		bool end_object()
+		{
+			if(!in_object) return error("end without an object");
+			if(stack.size() != object_stack_size + 1) return error("push without a pop");
+			if(object_list.empty())
+				return error("object '" + std::string(object_name) + "' is empty");
+
+			std::shared_ptr<Hittable> geometry;
+			if(object_list.size() == 1)
+			{
+				geometry = object_list.front();
+			}
+			else
+			{
+				geometry = std::make_shared<LinearBVHList>(
+					object_list, 0.f, 1.f, BVHSplit::SAH, bvh_source);
+			}
+			objects.emplace(object_name, std::move(geometry));
+
+			object_list.clear();
+			in_object = false;
+			return pop();
+		}
+
+		bool parse_instance()
+		{
+			std::string_view w;
+			if(!name(w, "object")) return false;
+			if(in_object) return error("instances can't be placed inside an object");
+			if(state.flip) return error("instances can't be flipped");
+
+			auto found = objects.find(w);
+			if(found == objects.end()) return error("unknown object '" + std::string(w) + "'");
+
+			instances.push_back({found->second, state.to_world});
+			num_objects++;
+			return true;
+		}
+
+		bool parse_camera()
+		{
+			std::string_view key;
+			bool lookfrom = false, lookat = false;
+			while(word(key))
+			{
+				bool ok;
+				if(key == "lookfrom")
+					ok = lookfrom = vector(camera.lookfrom);
+				else if(key == "lookat")
+					ok = lookat = vector(camera.lookat);
+				else if(key == "vup")
+					ok = vector(camera.vup);
+				else if(key == "vfov")
+					ok = number(camera.vfov);
+				else if(key == "aperture")
+					ok = number(camera.aperture);
+				else if(key == "focus")
+					ok = number(camera.focus_dist);
+				else if(key == "time")
+					ok = number(camera.time0) && number(camera.time1);
+				else
+					return error("unknown camera setting '" + std::string(key) + "'");
+
+				if(!ok) return false;
+			}
+
+			if(!lookfrom || !lookat) return error("the camera needs lookfrom and lookat");
+			has_camera = true;
+			return true;
+		}
+
+		std::string resolve(std::string_view file) const
+		{
+			if(file.empty() || file[0] == '/' || directory.empty()) return std::string(file);
+			return directory + std::string(file);
+		}
+
+	private:
+		std::string path;
+		std::string directory; // of the scene file, with a trailing separator
+		BVHSource* bvh_source; // null to build every BVH
+
+		const char* cur = nullptr;
+		const char* line_end = nullptr;
+
+		MaterialRegistry materials;
+		std::unordered_map<std::string_view, TextureId> textures;
+		std::unordered_map<std::string_view, MaterialId> materials_by_name;
+		std::unordered_map<std::string_view, std::shared_ptr<Hittable>> objects;
+
+		hittables_vec list;
+		hittables_vec lights;
+		std::vector<Instance> instances;
+		CameraSettings camera;
+		bool has_camera = false;
+
+		State state;
+		std::vector<State> stack;
+
+		// the object being defined, if any
+		bool in_object = false;
+		std::string_view object_name;
+		hittables_vec object_list;
+		size_t object_stack_size = 0;
+	};
+};
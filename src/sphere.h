@@ -1,16 +1,19 @@
 #pragma once
 
 #include "hittable.h"
+#include "onb.h"
 #include "util.h"
 
+#include <limits>
+
 class Sphere : public Hittable
 {
 public:
 	Sphere() = default;
-	Sphere(vec3 cen, float r, std::shared_ptr<Material> mat)
+	Sphere(vec3 cen, float r, MaterialId mat)
 		: centre(cen)
 		, radius(r)
-		, mat_ptr(mat)
+		, material(mat)
 	{}
 
 	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
@@ -27,10 +30,9 @@ public:
 			if(temp < t_max && temp > t_min)
 			{
 				rec.t = temp;
-				rec.p = r.point_at_parameter(rec.t);
-				rec.normal = (rec.p - centre) / radius;
-				rec.mat_ptr = mat_ptr;
-				Util::get_sphere_uv(rec.normal, rec.u, rec.v);
+				rec.local = oc + temp * r.direction();
+				rec.normal = rec.local / radius;
+				rec.object = this;
 				return true;
 			}
 
@@ -38,10 +40,9 @@ public:
 			if(temp < t_max && temp > t_min)
 			{
 				rec.t = temp;
-				rec.p = r.point_at_parameter(rec.t);
-				rec.normal = (rec.p - centre) / radius;
-				rec.mat_ptr = mat_ptr;
-				Util::get_sphere_uv(rec.normal, rec.u, rec.v);
+				rec.local = oc + temp * r.direction();
+				rec.normal = rec.local / radius;
+				rec.object = this;
 				return true;
 			}
 		}
@@ -49,14 +50,68 @@ public:
 		return false;
 	}
 
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		vec3 oc = r.origin() - centre;
+		float a = dot(r.direction(), r.direction());
+		float b = dot(oc, r.direction());
+		float c = dot(oc, oc) - radius * radius;
+		float discriminant = b * b - a * c;
+		if(discriminant <= 0.f) return false;
+
+		float root = sqrt(discriminant);
+		float temp = (-b - root) / a;
+		if(temp < t_max && temp > t_min) return true;
+
+		temp = (-b + root) / a;
+		return temp < t_max && temp > t_min;
+	}
+
+	// local is relative to the centre
+	virtual void surface(HitRecord& rec) const override
+	{
+		Util::get_sphere_uv(rec.local / radius, rec.u, rec.v);
+		rec.material = material;
+	}
+
 	virtual bool bounding_box(float t0, float t1, AABB& box) const override
 	{
-		box = AABB(centre - vec3(radius, radius, radius), centre + vec3(radius, radius, radius));
+		// the radius is negative for the inside of a hollow glass sphere
+		const vec3 extent(fabs(radius), fabs(radius), fabs(radius));
+		box = AABB(centre - extent, centre + extent);
 		return true;
 	}
 
+	// samples the cone of directions the sphere covers as seen from origin
+	virtual float pdf_value(const vec3& origin, const vec3& direction) const override
+	{
+		HitRecord rec;
+		if(!hit(Ray(origin, direction), 0.001f, std::numeric_limits<float>::max(), rec))
+			return 0.f;
+
+		float sin2_theta_max = radius * radius / (centre - origin).squared_length();
+		if(sin2_theta_max >= 1.f) return 0.f; // origin inside the sphere
+
+		float cos_theta_max = sqrt(1.f - sin2_theta_max);
+		return 1.f / (2.f * static_cast<float>(M_PI) * (1.f - cos_theta_max));
+	}
+
+	virtual vec3 random(const vec3& origin, Sampler& sampler) const override
+	{
+		vec3 direction = centre - origin;
+		float sin2_theta_max = radius * radius / direction.squared_length();
+		if(sin2_theta_max >= 1.f) return direction;
+
+		float cos_theta_max = sqrt(1.f - sin2_theta_max);
+		float z = 1.f + sampler.next_float() * (cos_theta_max - 1.f);
+		float phi = 2.f * static_cast<float>(M_PI) * sampler.next_float();
+		float sin_theta = sqrt(ffmax(0.f, 1.f - z * z));
+
+		return ONB(direction).local(cos(phi) * sin_theta, sin(phi) * sin_theta, z);
+	}
+
 private:
 	vec3 centre;
 	float radius;
-	std::shared_ptr<Material> mat_ptr;
+	MaterialId material;
 };
@@ -6,15 +6,17 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include <cstdint>
+#include <iostream>
 #include <memory>
+#include <string>
+#include <variant>
+#include <vector>
 
-class Texture
-{
-public:
-	virtual vec3 value(float u, float v, const vec3& p) const = 0;
-};
+// index of a texture in a TextureTable
+using TextureId = uint32_t;
 
-class ConstantTexture : public Texture
+class ConstantTexture
 {
 public:
 	ConstantTexture() = default;
@@ -22,43 +24,41 @@ public:
 		: colour(c)
 	{}
 
-	virtual vec3 value(float u, float v, const vec3& p) const override { return colour; }
+	vec3 value(float u, float v, const vec3& p) const { return colour; }
 
 private:
 	vec3 colour;
 };
 
-class CheckerTexture : public Texture
+// picks one of two other textures, TextureTable::value follows the choice
+class CheckerTexture
 {
 public:
 	CheckerTexture() = default;
-	CheckerTexture(std::shared_ptr<Texture> t0, std::shared_ptr<Texture> t1)
+	CheckerTexture(TextureId t0, TextureId t1)
 		: even(t0)
 		, odd(t1)
 	{}
 
-	virtual vec3 value(float u, float v, const vec3& p) const override
+	TextureId select(const vec3& p) const
 	{
 		float sines = sin(10.f * p.x()) * sin(10.f * p.y()) * sin(10.f * p.z());
-		if(sines < 0.f)
-			return odd->value(u, v, p);
-		else
-			return even->value(u, v, p);
+		return sines < 0.f ? odd : even;
 	}
 
 private:
-    std::shared_ptr<Texture> even, odd;
+	TextureId even, odd;
 };
 
-class NoiseTexture : public Texture
+class NoiseTexture
 {
 public:
 	NoiseTexture() = default;
-    explicit NoiseTexture(float sc)
+	explicit NoiseTexture(float sc)
 		: scale(sc)
 	{}
 
-	virtual vec3 value(float u, float v, const vec3& p) const override
+	vec3 value(float u, float v, const vec3& p) const
 	{
 		//return vec3(1.f, 1.f, 1.f) * 0.5f * (1.f + noise.turb(scale * p));
 		//return vec3(1.f, 1.f, 1.f) * noise.turb(scale * p);
@@ -70,20 +70,23 @@ private:
 	Perlin noise;
 };
 
-class ImageTexture : public Texture
+class ImageTexture
 {
 public:
 	ImageTexture() = default;
 	ImageTexture(const std::string& filepath)
+		: data(stbi_load(filepath.c_str(), &width, &height, &num_channels, 0), stbi_image_free)
 	{
-		data = stbi_load(filepath.c_str(), &width, &height, &num_channels, 0);
+		if(!data) std::cerr << "Could not load image '" << filepath << "'\n";
 	}
-	~ImageTexture() { stbi_image_free(data); }
 
-	virtual vec3 value(float u, float v, const vec3& p) const override
+	// a missing image shows up as magenta rather than crashing the render
+	vec3 value(float u, float v, const vec3& p) const
 	{
-        int i = static_cast<int>((u)*width);
-        int j = static_cast<int>((1.f - v) * height - 0.001f);
+		if(!data) return vec3(1.f, 0.f, 1.f);
+
+		int i = static_cast<int>((u)*width);
+		int j = static_cast<int>((1.f - v) * height - 0.001f);
 
 		if(i < 0) i = 0;
 		if(j < 0) j = 0;
@@ -91,14 +94,56 @@ public:
 		if(i > width - 1) i = width - 1;
 		if(j > height - 1) j = height - 1;
 
-        float r = static_cast<float>(int(data[3 * i + 3 * width * j]) / 255.0);
-        float g = static_cast<float>(int(data[3 * i + 3 * width * j + 1]) / 255.0);
-        float b = static_cast<float>(int(data[3 * i + 3 * width * j + 2]) / 255.0);
+		const unsigned char* pixels = data.get();
+		float r = static_cast<float>(int(pixels[3 * i + 3 * width * j]) / 255.0);
+		float g = static_cast<float>(int(pixels[3 * i + 3 * width * j + 1]) / 255.0);
+		float b = static_cast<float>(int(pixels[3 * i + 3 * width * j + 2]) / 255.0);
 
 		return vec3(r, g, b);
 	}
 
 private:
-	unsigned char* data;
-	int width, height, num_channels;
+	// shared so copies of the texture don't free the image twice
+	std::shared_ptr<unsigned char> data;
+	int width = 0, height = 0, num_channels = 0;
+};
+
+/*
+ *  The set of textures is closed, so a texture is a variant rather than a
+ *  class hierarchy and looking one up is a switch the compiler can inline
+ *  instead of a virtual call through a pointer.
+ */
+
+using Texture = std::variant<ConstantTexture, CheckerTexture, NoiseTexture, ImageTexture>;
+
+class TextureTable
+{
+public:
+	TextureId add(Texture texture)
+	{
+		textures.push_back(std::move(texture));
+		return static_cast<TextureId>(textures.size() - 1);
+	}
+
+	vec3 value(TextureId id, float u, float v, const vec3& p) const
+	{
+		// a checker only chooses between other textures, so follow it instead of recursing
+		while(const auto* checker = std::get_if<CheckerTexture>(&textures[id]))
+			id = checker->select(p);
+
+		const Texture& texture = textures[id];
+		switch(texture.index())
+		{
+		case 0: return std::get_if<ConstantTexture>(&texture)->value(u, v, p);
+		case 2: return std::get_if<NoiseTexture>(&texture)->value(u, v, p);
+		default: return std::get_if<ImageTexture>(&texture)->value(u, v, p);
+		}
+	}
+
+	size_t size() const { return textures.size(); }
+
+private:
+	static_assert(std::variant_size_v<Texture> == 4, "TextureTable::value needs a case per type");
+
+	std::vector<Texture> textures;
 };
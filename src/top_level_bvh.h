@@ -0,0 +1,114 @@
+#pragma once
+
+#include "affine.h"
+#include "bvh_build.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+/*
+ *  A placement of shared geometry in the scene. The geometry (the bottom
+ *  level structure) is usually a BVH or a mesh in its own coordinates and
+ *  can be placed any number of times with different transforms.
+ */
+
+struct Instance
+{
+	std::shared_ptr<Hittable> blas;
+	Affine to_world;
+};
+
+/*
+ *  Top level BVH over instances. Each instance stores a pointer to its
+ *  geometry and the transform into its coordinates, so memory grows with
+ *  the unique geometry rather than the number of copies. Rays are moved
+ *  into an instance's coordinates when its box is reached; the direction
+ *  isn't normalised so distances along the ray stay the same in both, and
+ *  only the normal of the closest hit is transformed back.
+ */
+
+class TopLevelBVH : public Hittable
+{
+public:
+	TopLevelBVH(const std::vector<Instance>& instances,
+				float time0,
+				float time1,
+				BVHSource* source = nullptr)
+	{
+		std::vector<AABB> boxes;
+		boxes.reserve(instances.size());
+		placed.reserve(instances.size());
+		for(const Instance& instance : instances)
+		{
+			AABB b;
+			if(!instance.blas->bounding_box(time0, time1, b))
+				std::cerr << "No bounding box in TopLevelBVH constructor\n";
+
+			boxes.push_back(instance.to_world.box(b));
+			placed.push_back({instance.blas.get(), instance.to_world.inverse()});
+			blas.push_back(instance.blas);
+		}
+
+		std::sort(blas.begin(), blas.end());
+		blas.erase(std::unique(blas.begin(), blas.end()), blas.end());
+
+		bvh = build_linear_bvh(boxes, BVHSplit::SAH, source);
+	}
+
+	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
+	{
+		const PlacedInstance* closest = nullptr;
+		bvh.traverse(r, t_min, t_max, [&](uint32_t i, float& closest_so_far) {
+			const PlacedInstance& instance = placed[i];
+			if(!instance.blas->hit(instance.to_local(r), t_min, closest_so_far, rec)) return false;
+
+			closest_so_far = rec.t;
+			closest = &instance;
+			return true;
+		});
+		if(!closest) return false;
+
+		rec.normal = unit_vector(closest->to_object.transposed_vector(rec.normal));
+		return true;
+	}
+
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		return bvh.traverse_any(r, t_min, t_max, [&](uint32_t i) {
+			const PlacedInstance& instance = placed[i];
+			return instance.blas->occluded(instance.to_local(r), t_min, t_max);
+		});
+	}
+
+	virtual bool bounding_box(float t0, float t1, AABB& box) const override
+	{
+		if(bvh.empty()) return false;
+
+		box = bvh.bounds();
+		return true;
+	}
+
+	size_t num_instances() const { return placed.size(); }
+	size_t num_blas() const { return blas.size(); }
+	BVHStats stats() const { return bvh.stats(); }
+
+private:
+	struct PlacedInstance
+	{
+		const Hittable* blas;
+		Affine to_object;
+
+		Ray to_local(const Ray& r) const
+		{
+			return Ray(to_object.point(r.origin()), to_object.vector(r.direction()), r.time());
+		}
+	};
+
+	std::vector<PlacedInstance> placed;
+	std::vector<std::shared_ptr<Hittable>> blas; // keeps the geometry alive
+	LinearBVH bvh;
+};
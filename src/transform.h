@@ -0,0 +1,132 @@
+#pragma once
+
+#include "affine.h"
+#include "flip_normals.h"
+#include "hittable.h"
+#include "rotate.h"
+#include "translate.h"
+
+#include <memory>
+#include <utility>
+
+/*
+ *  An object placed by an arbitrary affine transform. Both directions of
+ *  the transform are worked out once, so a hit costs one ray transform
+ *  into the object's coordinates and, if something was hit, one normal
+ *  transform back. As in the top level BVH the ray direction isn't
+ *  normalised, which keeps t the same in both coordinate systems.
+ */
+
+class Transform : public Hittable
+{
+public:
+	Transform(std::shared_ptr<Hittable> p, const Affine& to_world, bool flip_normals = false)
+		: ptr(std::move(p))
+		, _to_world(to_world)
+		, to_object(to_world.inverse())
+		, flip(flip_normals)
+	{}
+
+	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
+	{
+		if(!ptr->hit(to_local(r), t_min, t_max, rec)) return false;
+
+		const vec3 n = unit_vector(to_object.transposed_vector(rec.normal));
+		rec.normal = flip ? -n : n;
+		return true;
+	}
+
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		return ptr->occluded(to_local(r), t_min, t_max);
+	}
+
+	virtual bool bounding_box(float t0, float t1, AABB& box) const override
+	{
+		if(!ptr->bounding_box(t0, t1, box)) return false;
+
+		box = _to_world.box(box);
+		return true;
+	}
+
+	// solid angles are only preserved by rotations and translations, so
+	// sampling a light through a transform that scales it isn't exact
+	virtual float pdf_value(const vec3& origin, const vec3& direction) const override
+	{
+		return ptr->pdf_value(to_object.point(origin), to_object.vector(direction));
+	}
+
+	virtual vec3 random(const vec3& origin, Sampler& sampler) const override
+	{
+		return _to_world.vector(ptr->random(to_object.point(origin), sampler));
+	}
+
+	const std::shared_ptr<Hittable>& object() const { return ptr; }
+	const Affine& to_world() const { return _to_world; }
+	bool flips_normals() const { return flip; }
+
+private:
+	Ray to_local(const Ray& r) const
+	{
+		return Ray(to_object.point(r.origin()), to_object.vector(r.direction()), r.time());
+	}
+
+	std::shared_ptr<Hittable> ptr;
+	Affine _to_world;
+	Affine to_object;
+	bool flip;
+};
+
+/*
+ *  Scene build pass collapsing a chain of Translate, RotateY, FlipNormals
+ *  and Transform wrappers into a single Transform, so the object costs one
+ *  indirection instead of one per wrapper and gets a correct bounding box.
+ *  A chain that only flips normals stays a FlipNormals, which doesn't need
+ *  to touch the ray at all.
+ */
+
+inline std::shared_ptr<Hittable> fold_transforms(const std::shared_ptr<Hittable>& object)
+{
+	std::shared_ptr<Hittable> inner = object;
+	Affine to_world;
+	bool flip = false, moved = false;
+	int wrappers = 0;
+
+	for(;; wrappers++)
+	{
+		const Hittable* h = inner.get();
+		if(auto t = dynamic_cast<const Translate*>(h))
+		{
+			to_world = to_world * t->transform();
+			inner = t->object();
+			moved = true;
+		}
+		else if(auto t = dynamic_cast<const RotateY*>(h))
+		{
+			to_world = to_world * t->transform();
+			inner = t->object();
+			moved = true;
+		}
+		else if(auto t = dynamic_cast<const Transform*>(h))
+		{
+			to_world = to_world * t->to_world();
+			flip = flip != t->flips_normals();
+			inner = t->object();
+			moved = true;
+		}
+		else if(auto t = dynamic_cast<const FlipNormals*>(h))
+		{
+			flip = !flip;
+			inner = t->object();
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if(moved) return std::make_shared<Transform>(inner, to_world, flip);
+	if(wrappers < 2) return object;
+	if(flip) return std::make_shared<FlipNormals>(inner);
+	return inner;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "aabb.h"
+#include "affine.h"
 #include "hittable.h"
 
 #include <memory>
@@ -15,21 +16,20 @@ public:
 
     virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
     {
-        Ray moved_r(r.origin() - offset, r.direction(), r.time());
-        if(ptr->hit(moved_r, t_min, t_max, rec))
-        {
-            rec.p += offset;
-            return true;
-        }
-        else
-            return false;
+        // the ray keeps its direction so t, and the point resolved from it, carry over
+        return ptr->hit(Ray(r.origin() - offset, r.direction(), r.time()), t_min, t_max, rec);
+    }
+
+    virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+    {
+        return ptr->occluded(Ray(r.origin() - offset, r.direction(), r.time()), t_min, t_max);
     }
 
     virtual bool bounding_box(float t0, float t1, AABB& box) const override
     {
         if(ptr->bounding_box(t0, t1, box))
         {
-            box = AABB(box.max() + offset, box.max() + offset);
+            box = AABB(box.min() + offset, box.max() + offset);
             return true;
         }
         else
@@ -38,6 +38,9 @@ public:
         }
     }
 
+    const std::shared_ptr<Hittable>& object() const { return ptr; }
+    Affine transform() const { return Affine::translation(offset); }
+
 private:
     std::shared_ptr<Hittable> ptr;
     vec3 offset;
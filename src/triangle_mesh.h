@@ -0,0 +1,204 @@
+#pragma once
+
+#include "aabb.h"
+#include "bvh_build.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*
+ *  Vertex data of an indexed triangle mesh, one array per component so
+ *  nothing is padded and large models stay compact. Normals and texture
+ *  coordinates are optional. Each triangle has three position indices; the
+ *  normal and uv indices may be empty, in which case the position indices
+ *  are used for them too (as in PLY, where every vertex has all its
+ *  attributes), or given separately (as in OBJ).
+ */
+
+struct MeshData
+{
+	std::vector<float> px, py, pz;
+	std::vector<float> nx, ny, nz;
+	std::vector<float> tu, tv;
+
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> normal_indices;
+	std::vector<uint32_t> uv_indices;
+
+	size_t num_vertices() const { return px.size(); }
+	size_t num_triangles() const { return indices.size() / 3; }
+	bool has_normals() const { return !nx.empty(); }
+	bool has_uvs() const { return !tu.empty(); }
+
+	vec3 position(uint32_t i) const { return vec3(px[i], py[i], pz[i]); }
+	vec3 normal(uint32_t i) const { return vec3(nx[i], ny[i], nz[i]); }
+
+	// corner is 0, 1 or 2
+	uint32_t position_index(uint32_t tri, int corner) const { return indices[3 * tri + corner]; }
+	uint32_t normal_index(uint32_t tri, int corner) const
+	{
+		return normal_indices.empty() ? indices[3 * tri + corner]
+									  : normal_indices[3 * tri + corner];
+	}
+	uint32_t uv_index(uint32_t tri, int corner) const
+	{
+		return uv_indices.empty() ? indices[3 * tri + corner] : uv_indices[3 * tri + corner];
+	}
+
+	size_t memory_usage() const
+	{
+		return sizeof(float) * (px.size() + py.size() + pz.size() + nx.size() + ny.size() +
+								nz.size() + tu.size() + tv.size()) +
+			   sizeof(uint32_t) * (indices.size() + normal_indices.size() + uv_indices.size());
+	}
+};
+
+/*
+ *  A triangle mesh with its own BVH over the triangles. The vertex data is
+ *  shared, so several meshes (or later instances) can use one copy. Hits
+ *  record the triangle and its barycentric coordinates; the normal is only
+ *  worked out for the closest triangle and the uv once the hit is resolved.
+ */
+
+class TriangleMesh : public Hittable
+{
+public:
+	TriangleMesh(std::shared_ptr<const MeshData> data,
+				 MaterialId mat,
+				 BVHSplit split = BVHSplit::SAH,
+				 BVHSource* source = nullptr)
+		: mesh(std::move(data))
+		, material(mat)
+	{
+		std::vector<AABB> boxes(mesh->num_triangles());
+		for(uint32_t tri = 0; tri < boxes.size(); tri++)
+		{
+			AABB box = AABB::empty();
+			for(int corner = 0; corner < 3; corner++)
+				box.grow(mesh->position(mesh->position_index(tri, corner)));
+			boxes[tri] = box;
+		}
+
+		bvh = build_linear_bvh(boxes, split, source);
+	}
+
+	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
+	{
+		uint32_t closest_tri = 0;
+		float closest_t = t_max, closest_b1 = 0.f, closest_b2 = 0.f;
+		bool found = bvh.traverse(r, t_min, t_max, [&](uint32_t tri, float& closest_so_far) {
+			float t, b1, b2;
+			if(!intersect(r, tri, t_min, closest_so_far, t, b1, b2)) return false;
+
+			closest_so_far = closest_t = t;
+			closest_tri = tri;
+			closest_b1 = b1;
+			closest_b2 = b2;
+			return true;
+		});
+		if(!found) return false;
+
+		rec.t = closest_t;
+		rec.normal = normal(closest_tri, closest_b1, closest_b2);
+		rec.local = vec3(closest_b1, closest_b2, 0.f);
+		rec.object = this;
+		rec.primitive = closest_tri;
+		return true;
+	}
+
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		return bvh.traverse_any(r, t_min, t_max, [&](uint32_t tri) {
+			float t, b1, b2;
+			return intersect(r, tri, t_min, t_max, t, b1, b2);
+		});
+	}
+
+	// local holds the barycentric coordinates of the second and third corners
+	virtual void surface(HitRecord& rec) const override
+	{
+		const float b1 = rec.local.x(), b2 = rec.local.y(), b0 = 1.f - b1 - b2;
+		if(mesh->has_uvs())
+		{
+			const uint32_t i0 = mesh->uv_index(rec.primitive, 0);
+			const uint32_t i1 = mesh->uv_index(rec.primitive, 1);
+			const uint32_t i2 = mesh->uv_index(rec.primitive, 2);
+			rec.u = b0 * mesh->tu[i0] + b1 * mesh->tu[i1] + b2 * mesh->tu[i2];
+			rec.v = b0 * mesh->tv[i0] + b1 * mesh->tv[i1] + b2 * mesh->tv[i2];
+		}
+		else
+		{
+			rec.u = b1;
+			rec.v = b2;
+		}
+
+		rec.material = material;
+	}
+
+	virtual bool bounding_box(float t0, float t1, AABB& box) const override
+	{
+		if(bvh.empty()) return false;
+
+		box = bvh.bounds();
+		return true;
+	}
+
+	const MeshData& data() const { return *mesh; }
+	BVHStats stats() const { return bvh.stats(); }
+
+private:
+	// Moller-Trumbore
+	bool intersect(const Ray& r,
+				   uint32_t tri,
+				   float t_min,
+				   float t_max,
+				   float& t,
+				   float& b1,
+				   float& b2) const
+	{
+		const vec3 v0 = mesh->position(mesh->position_index(tri, 0));
+		const vec3 e1 = mesh->position(mesh->position_index(tri, 1)) - v0;
+		const vec3 e2 = mesh->position(mesh->position_index(tri, 2)) - v0;
+
+		const vec3 pvec = cross(r.direction(), e2);
+		const float det = dot(e1, pvec);
+		if(det == 0.f) return false; // parallel to the triangle
+
+		const float inv_det = 1.f / det;
+		const vec3 tvec = r.origin() - v0;
+		b1 = dot(tvec, pvec) * inv_det;
+		if(b1 < 0.f || b1 > 1.f) return false;
+
+		const vec3 qvec = cross(tvec, e1);
+		b2 = dot(r.direction(), qvec) * inv_det;
+		if(b2 < 0.f || b1 + b2 > 1.f) return false;
+
+		t = dot(e2, qvec) * inv_det;
+		return t > t_min && t < t_max;
+	}
+
+	// interpolated vertex normal if the mesh has them, otherwise the face normal
+	vec3 normal(uint32_t tri, float b1, float b2) const
+	{
+		if(mesh->has_normals())
+		{
+			const vec3 n = (1.f - b1 - b2) * mesh->normal(mesh->normal_index(tri, 0)) +
+						   b1 * mesh->normal(mesh->normal_index(tri, 1)) +
+						   b2 * mesh->normal(mesh->normal_index(tri, 2));
+			if(n.squared_length() > 0.f) return unit_vector(n);
+		}
+
+		const vec3 v0 = mesh->position(mesh->position_index(tri, 0));
+		return unit_vector(cross(mesh->position(mesh->position_index(tri, 1)) - v0,
+								 mesh->position(mesh->position_index(tri, 2)) - v0));
+	}
+
+private:
+	std::shared_ptr<const MeshData> mesh;
+	MaterialId material;
+	LinearBVH bvh;
+};
@@ -0,0 +1,447 @@
+#pragma once
+
+#include "aabb.h"
+#include "bvh_build.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+/*
+ *  BVH with Width (4 or 8) children per node, made by collapsing the binary
+ *  LinearBVH. The child boxes of a node are stored as structure of arrays so
+ *  one SSE (Width 4) or AVX (Width 8) slab test intersects the ray with all
+ *  of them at once. Without those instruction sets a plain loop is used,
+ *  which the compiler is free to vectorise.
+ */
+
+template <int Width>
+struct alignas(64) WideBVHNode
+{
+	float min_x[Width], min_y[Width], min_z[Width];
+	float max_x[Width], max_y[Width], max_z[Width];
+	int32_t child[Width]; // node index, or offset into the primitive indices for leaves
+	uint16_t count[Width]; // number of primitives in a leaf, 0 for an interior child
+	uint8_t num_children;
+};
+
+template <int Width>
+class WideBVH
+{
+	static_assert(Width == 4 || Width == 8, "WideBVH supports 4 or 8 children per node");
+
+public:
+	WideBVH() = default;
+	explicit WideBVH(const LinearBVH& binary)
+		: indices(binary.primitive_indices(),
+				  binary.primitive_indices() + binary.num_primitive_indices())
+	{
+		if(binary.empty()) return;
+
+		nodes.reserve(binary.num_nodes() / 2 + 1);
+		collapse(binary.node_array(), 0);
+	}
+
+	bool empty() const { return nodes.empty(); }
+
+	// same contract as LinearBVH::traverse
+	template <typename Intersect>
+	bool traverse(const Ray& r, float t_min, float t_max, Intersect&& intersect) const
+	{
+		if(nodes.empty()) return false;
+
+		struct Entry
+		{
+			uint32_t node;
+			float t_near;
+		};
+
+		const RayData ray(r);
+		Entry stack[64 * Width];
+		int stack_size = 0;
+		stack[stack_size++] = {0, t_min};
+		bool hit_anything = false;
+
+		while(stack_size > 0)
+		{
+			const Entry entry = stack[--stack_size];
+			if(entry.t_near >= t_max) continue; // a closer hit was found since it was pushed
+
+			const WideBVHNode<Width>& node = nodes[entry.node];
+			float t_near[Width];
+			int mask = intersect_children(node, ray, t_min, t_max, t_near);
+			if(mask == 0) continue;
+
+			// order the children we hit from near to far
+			int order[Width];
+			int num_hit = 0;
+			for(int i = 0; i < Width; i++)
+			{
+				if(!(mask & (1 << i))) continue;
+
+				int j = num_hit++;
+				for(; j > 0 && t_near[order[j - 1]] > t_near[i]; j--) order[j] = order[j - 1];
+				order[j] = i;
+			}
+
+			// leaves are intersected straight away so they can shrink t_max,
+			// interior children are pushed far first so the nearest is popped next
+			for(int k = 0; k < num_hit; k++)
+			{
+				const int i = order[k];
+				if(node.count[i] == 0 || t_near[i] >= t_max) continue;
+
+				const uint32_t end = static_cast<uint32_t>(node.child[i]) + node.count[i];
+				for(uint32_t p = static_cast<uint32_t>(node.child[i]); p < end; p++)
+				{
+					if(intersect(indices[p], t_max)) hit_anything = true;
+				}
+			}
+
+			for(int k = num_hit - 1; k >= 0; k--)
+			{
+				const int i = order[k];
+				if(node.count[i] == 0 && t_near[i] < t_max)
+					stack[stack_size++] = {static_cast<uint32_t>(node.child[i]), t_near[i]};
+			}
+		}
+
+		return hit_anything;
+	}
+
+	// stops at the first primitive for which test(primitive_index) is true
+	template <typename Test>
+	bool traverse_any(const Ray& r, float t_min, float t_max, Test&& test) const
+	{
+		if(nodes.empty()) return false;
+
+		const RayData ray(r);
+		uint32_t stack[64 * Width];
+		int stack_size = 0;
+		stack[stack_size++] = 0;
+
+		while(stack_size > 0)
+		{
+			const WideBVHNode<Width>& node = nodes[stack[--stack_size]];
+			float t_near[Width];
+			int mask = intersect_children(node, ray, t_min, t_max, t_near);
+
+			for(int i = 0; mask != 0; i++, mask >>= 1)
+			{
+				if(!(mask & 1)) continue;
+
+				if(node.count[i] == 0)
+				{
+					stack[stack_size++] = static_cast<uint32_t>(node.child[i]);
+					continue;
+				}
+
+				const uint32_t end = static_cast<uint32_t>(node.child[i]) + node.count[i];
+				for(uint32_t p = static_cast<uint32_t>(node.child[i]); p < end; p++)
+				{
+					if(test(indices[p])) return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	BVHStats stats() const
+	{
+		BVHStats s;
+		if(!nodes.empty()) collect_stats(s, 0, 1, node_bounds(0).surface_area());
+		return s;
+	}
+
+private:
+	// ray data broadcast across the lanes once per traversal
+	struct RayData
+	{
+		explicit RayData(const Ray& r)
+			: origin(r.origin())
+			, inv_dir(r.inv_direction())
+		{}
+
+		vec3 origin;
+		vec3 inv_dir;
+	};
+
+	/*
+	 *  Slab test against every child box of the node. Returns a bit mask of
+	 *  the children that were hit and their entry distances in t_near.
+	 */
+	static int intersect_children(const WideBVHNode<Width>& node,
+								  const RayData& ray,
+								  float t_min,
+								  float t_max,
+								  float* t_near)
+	{
+		const int valid = (1 << node.num_children) - 1;
+
+#if defined(__AVX__)
+		if constexpr(Width == 8)
+		{
+			const __m256 ox = _mm256_set1_ps(ray.origin.x());
+			const __m256 oy = _mm256_set1_ps(ray.origin.y());
+			const __m256 oz = _mm256_set1_ps(ray.origin.z());
+			const __m256 ix = _mm256_set1_ps(ray.inv_dir.x());
+			const __m256 iy = _mm256_set1_ps(ray.inv_dir.y());
+			const __m256 iz = _mm256_set1_ps(ray.inv_dir.z());
+
+			const __m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_x), ox), ix);
+			const __m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_x), ox), ix);
+			const __m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_y), oy), iy);
+			const __m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_y), oy), iy);
+			const __m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_z), oz), iz);
+			const __m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_z), oz), iz);
+
+			const __m256 enter = _mm256_max_ps(
+				_mm256_max_ps(_mm256_min_ps(t0x, t1x), _mm256_min_ps(t0y, t1y)),
+				_mm256_max_ps(_mm256_min_ps(t0z, t1z), _mm256_set1_ps(t_min)));
+			const __m256 exit = _mm256_min_ps(
+				_mm256_min_ps(_mm256_max_ps(t0x, t1x), _mm256_max_ps(t0y, t1y)),
+				_mm256_min_ps(_mm256_max_ps(t0z, t1z), _mm256_set1_ps(t_max)));
+
+			_mm256_storeu_ps(t_near, enter);
+			return _mm256_movemask_ps(_mm256_cmp_ps(enter, exit, _CMP_LT_OQ)) & valid;
+		}
+#endif
+
+#if defined(__SSE__) || defined(_M_X64)
+		if constexpr(Width == 4)
+		{
+			const __m128 ox = _mm_set1_ps(ray.origin.x());
+			const __m128 oy = _mm_set1_ps(ray.origin.y());
+			const __m128 oz = _mm_set1_ps(ray.origin.z());
+			const __m128 ix = _mm_set1_ps(ray.inv_dir.x());
+			const __m128 iy = _mm_set1_ps(ray.inv_dir.y());
+			const __m128 iz = _mm_set1_ps(ray.inv_dir.z());
+
+			const __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_x), ox), ix);
+			const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_x), ox), ix);
+			const __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_y), oy), iy);
+			const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_y), oy), iy);
+			const __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_z), oz), iz);
+			const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_z), oz), iz);
+
+			const __m128 enter =
+				_mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+						   _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_set1_ps(t_min)));
+			const __m128 exit =
+				_mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+						   _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(t_max)));
+
+			_mm_storeu_ps(t_near, enter);
+			return _mm_movemask_ps(_mm_cmplt_ps(enter, exit)) & valid;
+		}
+#endif
+
+		int mask = 0;
+		for(int i = 0; i < Width; i++)
+		{
+			const float t0x = (node.min_x[i] - ray.origin.x()) * ray.inv_dir.x();
+			const float t1x = (node.max_x[i] - ray.origin.x()) * ray.inv_dir.x();
+			const float t0y = (node.min_y[i] - ray.origin.y()) * ray.inv_dir.y();
+			const float t1y = (node.max_y[i] - ray.origin.y()) * ray.inv_dir.y();
+			const float t0z = (node.min_z[i] - ray.origin.z()) * ray.inv_dir.z();
+			const float t1z = (node.max_z[i] - ray.origin.z()) * ray.inv_dir.z();
+
+			const float enter = ffmax(ffmax(ffmin(t0x, t1x), ffmin(t0y, t1y)),
+									  ffmax(ffmin(t0z, t1z), t_min));
+			const float exit = ffmin(ffmin(ffmax(t0x, t1x), ffmax(t0y, t1y)),
+									 ffmin(ffmax(t0z, t1z), t_max));
+
+			t_near[i] = enter;
+			if(enter < exit) mask |= 1 << i;
+		}
+
+		return mask & valid;
+	}
+
+	/*
+	 *  Turns the binary subtree rooted at binary_index into wide nodes by
+	 *  repeatedly opening the child with the largest surface area until the
+	 *  node is full. Returns the index of the new node.
+	 */
+	uint32_t collapse(const LinearBVHNode* binary, uint32_t binary_index)
+	{
+		uint32_t slots[Width];
+		int num_slots = 0;
+
+		const LinearBVHNode& root = binary[binary_index];
+		if(root.num_primitives > 0)
+		{
+			slots[num_slots++] = binary_index;
+		}
+		else
+		{
+			slots[num_slots++] = binary_index + 1;
+			slots[num_slots++] = root.second_child_offset;
+		}
+
+		while(num_slots < Width)
+		{
+			int best = -1;
+			float best_area = -1.f;
+			for(int i = 0; i < num_slots; i++)
+			{
+				const LinearBVHNode& n = binary[slots[i]];
+				if(n.num_primitives == 0 && n.bounds.surface_area() > best_area)
+				{
+					best = i;
+					best_area = n.bounds.surface_area();
+				}
+			}
+
+			if(best < 0) break;
+
+			const uint32_t opened = slots[best];
+			slots[best] = opened + 1;
+			slots[num_slots++] = binary[opened].second_child_offset;
+		}
+
+		const auto index = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+
+		WideBVHNode<Width> node = {};
+		node.num_children = static_cast<uint8_t>(num_slots);
+		for(int i = 0; i < num_slots; i++)
+		{
+			const LinearBVHNode& n = binary[slots[i]];
+			node.min_x[i] = n.bounds.min().x();
+			node.min_y[i] = n.bounds.min().y();
+			node.min_z[i] = n.bounds.min().z();
+			node.max_x[i] = n.bounds.max().x();
+			node.max_y[i] = n.bounds.max().y();
+			node.max_z[i] = n.bounds.max().z();
+
+			if(n.num_primitives > 0)
+			{
+				node.child[i] = static_cast<int32_t>(n.primitives_offset);
+				node.count[i] = n.num_primitives;
+			}
+			else
+			{
+				node.child[i] = static_cast<int32_t>(collapse(binary, slots[i]));
+				node.count[i] = 0;
+			}
+		}
+
+		nodes[index] = node;
+		return index;
+	}
+
+	AABB node_bounds(uint32_t index) const
+	{
+		const WideBVHNode<Width>& node = nodes[index];
+		AABB bounds = AABB::empty();
+		for(int i = 0; i < node.num_children; i++)
+			bounds.grow(child_bounds(node, i));
+
+		return bounds;
+	}
+
+	static AABB child_bounds(const WideBVHNode<Width>& node, int i)
+	{
+		return AABB(vec3(node.min_x[i], node.min_y[i], node.min_z[i]),
+					vec3(node.max_x[i], node.max_y[i], node.max_z[i]));
+	}
+
+	void collect_stats(BVHStats& s, uint32_t index, int depth, float root_area) const
+	{
+		const WideBVHNode<Width>& node = nodes[index];
+		s.add_interior(root_area > 0.f ? node_bounds(index).surface_area() / root_area : 1.f);
+
+		for(int i = 0; i < node.num_children; i++)
+		{
+			if(node.count[i] > 0)
+			{
+				const float area = child_bounds(node, i).surface_area();
+				s.add_leaf(root_area > 0.f ? area / root_area : 1.f, node.count[i], depth + 1);
+			}
+			else
+			{
+				collect_stats(s, static_cast<uint32_t>(node.child[i]), depth + 1, root_area);
+			}
+		}
+	}
+
+private:
+	std::vector<WideBVHNode<Width>> nodes;
+	std::vector<uint32_t> indices;
+};
+
+/*
+ *  A list of hittables accelerated by a WideBVH, see LinearBVHList.
+ */
+
+template <int Width>
+class WideBVHList : public Hittable
+{
+public:
+	WideBVHList(const hittables_vec& l, float time0, float time1, BVHSplit split = BVHSplit::SAH)
+		: list(l)
+	{
+		std::vector<AABB> boxes;
+		boxes.reserve(list.size());
+		raw.reserve(list.size());
+		for(const auto& h : list)
+		{
+			AABB b;
+			if(!h->bounding_box(time0, time1, b))
+				std::cerr << "No bounding box in WideBVHList constructor\n";
+
+			boxes.push_back(b);
+			raw.push_back(h.get());
+		}
+
+		LinearBVH binary(boxes, split);
+		bounds = binary.bounds();
+		bvh = WideBVH<Width>(binary);
+	}
+
+	virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override
+	{
+		return bvh.traverse(r, t_min, t_max, [&](uint32_t i, float& closest_so_far) {
+			if(raw[i]->hit(r, t_min, closest_so_far, rec))
+			{
+				closest_so_far = rec.t;
+				return true;
+			}
+
+			return false;
+		});
+	}
+
+	virtual bool occluded(const Ray& r, float t_min, float t_max) const override
+	{
+		return bvh.traverse_any(
+			r, t_min, t_max, [&](uint32_t i) { return raw[i]->occluded(r, t_min, t_max); });
+	}
+
+	virtual bool bounding_box(float t0, float t1, AABB& box) const override
+	{
+		if(bvh.empty()) return false;
+
+		box = bounds;
+		return true;
+	}
+
+	BVHStats stats() const { return bvh.stats(); }
+
+private:
+	hittables_vec list;
+	std::vector<const Hittable*> raw;
+	WideBVH<Width> bvh;
+	AABB bounds;
+};
+
+using BVH4List = WideBVHList<4>;
+using BVH8List = WideBVHList<8>;